@@ -0,0 +1,134 @@
+#include "benchmark.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace
+{
+std::atomic<std::uint64_t> allocation_count{ 0 };
+
+auto
+counted_allocate(std::size_t size) -> void*
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size); pointer != nullptr) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+// For types aligned beyond what malloc guarantees, allocated with the std::align_val_t overloads.
+auto
+counted_allocate(std::size_t size, std::align_val_t alignment) -> void*
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc() takes only sizes which are a multiple of the alignment
+    size = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#if defined(_WIN32)
+    void* pointer = _aligned_malloc(size, align);
+#else
+    void* pointer = std::aligned_alloc(align, size);
+#endif
+    if (pointer != nullptr) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void
+aligned_free(void* pointer) noexcept
+{
+#if defined(_WIN32)
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+} // namespace
+
+auto
+bench::allocations() -> std::uint64_t
+{
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+// Replacing the global allocation functions lets every benchmark report allocations per
+// operation, including those made by the SDK on its own threads.
+auto
+operator new(std::size_t size) -> void*
+{
+    return counted_allocate(size);
+}
+
+auto
+operator new[](std::size_t size) -> void*
+{
+    return counted_allocate(size);
+}
+
+void
+operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete(void* pointer, std::size_t /* size */) noexcept
+{
+    std::free(pointer);
+}
+
+void
+operator delete[](void* pointer, std::size_t /* size */) noexcept
+{
+    std::free(pointer);
+}
+
+auto
+operator new(std::size_t size, std::align_val_t alignment) -> void*
+{
+    return counted_allocate(size, alignment);
+}
+
+auto
+operator new[](std::size_t size, std::align_val_t alignment) -> void*
+{
+    return counted_allocate(size, alignment);
+}
+
+void
+operator delete(void* pointer, std::align_val_t /* alignment */) noexcept
+{
+    aligned_free(pointer);
+}
+
+void
+operator delete[](void* pointer, std::align_val_t /* alignment */) noexcept
+{
+    aligned_free(pointer);
+}
+
+void
+operator delete(void* pointer, std::size_t /* size */, std::align_val_t /* alignment */) noexcept
+{
+    aligned_free(pointer);
+}
+
+void
+operator delete[](void* pointer, std::size_t /* size */, std::align_val_t /* alignment */) noexcept
+{
+    aligned_free(pointer);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace bench
+{
+// Number of heap allocations made so far by any thread in the process. Counted by the
+// replacement operator new in benchmark.cxx.
+auto
+allocations() -> std::uint64_t;
+
+// Connection settings and run length, taken from the environment so that the same binaries can
+// run against a local cluster, a remote one, or a mock server.
+struct settings {
+    std::string connection_string{ env_or("CB_CONNECTION_STRING", "couchbase://127.0.0.1") };
+    std::string username{ env_or("CB_USERNAME", "Administrator") };
+    std::string password{ env_or("CB_PASSWORD", "password") };
+    std::string bucket_name{ env_or("CB_BUCKET", "default") };
+    std::size_t iterations{ env_count("CB_BENCH_ITERATIONS", 10'000) };
+    std::size_t warmup{ env_count("CB_BENCH_WARMUP", 100) };
+
+    static auto env_or(const char* name, const char* fallback) -> std::string
+    {
+        const char* value = std::getenv(name);
+        return value == nullptr ? fallback : value;
+    }
+
+    // Exits with a message, rather than an uncaught exception, when the variable is set to
+    // anything but a whole number.
+    static auto env_count(const char* name, std::size_t fallback) -> std::size_t
+    {
+        const char* value = std::getenv(name);
+        if (value == nullptr) {
+            return fallback;
+        }
+        std::string_view text{ value };
+        std::size_t count{};
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), count);
+        if (ec != std::errc{} || end != text.data() + text.size()) {
+            fmt::println("{} must be a whole number, not \"{}\"", name, text);
+            std::exit(2);
+        }
+        return count;
+    }
+};
+
+inline auto
+connect(const settings& config) -> couchbase::cluster
+{
+    auto options = couchbase::cluster_options(config.username, config.password);
+    options.apply_profile("wan_development");
+    auto [err, cluster] = couchbase::cluster::connect(config.connection_string, options).get();
+    if (err) {
+        fmt::println("Unable to connect to {}: {}", config.connection_string, err);
+        std::exit(1);
+    }
+    return cluster;
+}
+
+struct report {
+    std::string name{};
+    std::size_t operations{ 0 };
+    std::size_t errors{ 0 };
+    std::chrono::nanoseconds elapsed{};
+    std::vector<std::chrono::nanoseconds> latencies{};
+    std::uint64_t allocations{ 0 };
+
+    auto percentile(double p) const -> std::chrono::nanoseconds
+    {
+        if (latencies.empty()) {
+            return {};
+        }
+        auto last = static_cast<double>(latencies.size() - 1);
+        return latencies[static_cast<std::size_t>(p / 100.0 * last)];
+    }
+
+    void print() const
+    {
+        using us = std::chrono::duration<double, std::micro>;
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+        fmt::println(
+          "{:<12} {:>8} ops {:>10.0f} ops/s  p50 {:>8.1f}us  p90 {:>8.1f}us  p99 {:>8.1f}us  "
+          "p99.9 {:>8.1f}us  {:>6.1f} allocs/op  {} errors",
+          name,
+          operations,
+          seconds > 0 ? static_cast<double>(operations) / seconds : 0.0,
+          us(percentile(50)).count(),
+          us(percentile(90)).count(),
+          us(percentile(99)).count(),
+          us(percentile(99.9)).count(),
+          operations > 0 ? static_cast<double>(allocations) / static_cast<double>(operations)
+                         : 0.0,
+          errors
+        );
+    }
+};
+
+// Runs `operation` -- which performs one request and returns its couchbase::error -- `warmup`
+// times without measuring, then `iterations` times, timing each call.
+template<typename Operation>
+auto
+run(const std::string& name, const settings& config, Operation&& operation) -> report
+{
+    for (std::size_t i = 0; i < config.warmup; ++i) {
+        operation(i);
+    }
+
+    report result{ name };
+    result.latencies.reserve(config.iterations);
+    auto allocations_before = allocations();
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < config.iterations; ++i) {
+        auto op_start = std::chrono::steady_clock::now();
+        auto err = operation(i);
+        result.latencies.push_back(std::chrono::steady_clock::now() - op_start);
+        if (err) {
+            ++result.errors;
+        }
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start;
+    // The latencies were reserved up front, so the timed loop itself does not allocate
+    result.allocations = allocations() - allocations_before;
+    result.operations = config.iterations;
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+} // namespace bench
@@ -0,0 +1,35 @@
+#include "benchmark.hxx"
+
+#include <tao/json.hpp>
+
+auto
+main() -> int
+{
+    bench::settings config;
+    auto cluster = bench::connect(config);
+    auto collection = cluster.bucket(config.bucket_name).default_collection();
+
+    // Operations cycle over a fixed set of keys, so that gets and replaces find their documents
+    constexpr std::size_t key_count{ 1'000 };
+    auto key = [](std::size_t i) { return fmt::format("bench-kv-{}", i % key_count); };
+    tao::json::value document{
+        { "name", "Benchmark" },
+        { "counter", 0 },
+        { "description", "A small document, typical of a key-value workload" },
+    };
+
+    bench::run("upsert", config, [&](std::size_t i) {
+        return collection.upsert(key(i), document).get().first;
+    }).print();
+
+    bench::run("get", config, [&](std::size_t i) {
+        return collection.get(key(i)).get().first;
+    }).print();
+
+    bench::run("replace", config, [&](std::size_t i) {
+        return collection.replace(key(i), document).get().first;
+    }).print();
+
+    cluster.close().get();
+    return 0;
+}
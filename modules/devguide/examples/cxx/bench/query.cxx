@@ -0,0 +1,20 @@
+#include "benchmark.hxx"
+
+auto
+main() -> int
+{
+    bench::settings config;
+    auto cluster = bench::connect(config);
+    auto statement = fmt::format("SELECT META().id FROM `{}` LIMIT 10", config.bucket_name);
+
+    bench::run("query_adhoc", config, [&](std::size_t /* i */) {
+        return cluster.query(statement, couchbase::query_options().adhoc(true)).get().first;
+    }).print();
+
+    bench::run("query_prep", config, [&](std::size_t /* i */) {
+        return cluster.query(statement, couchbase::query_options().adhoc(false)).get().first;
+    }).print();
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include "benchmark.hxx"
+
+auto
+main() -> int
+{
+    bench::settings config;
+    auto cluster = bench::connect(config);
+    auto collection = cluster.bucket(config.bucket_name).default_collection();
+
+    // Each operation is a complete prefix scan over the documents written by the KV benchmark
+    bench::run("prefix_scan", config, [&](std::size_t /* i */) {
+        auto [err, result] = collection.scan(couchbase::prefix_scan("bench-kv-")).get();
+        if (err) {
+            return err;
+        }
+        for (auto [iter_err, item] : result) {
+            if (iter_err) {
+                return iter_err;
+            }
+        }
+        return couchbase::error{};
+    }).print();
+
+    cluster.close().get();
+    return 0;
+}
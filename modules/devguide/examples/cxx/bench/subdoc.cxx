@@ -0,0 +1,44 @@
+#include "benchmark.hxx"
+
+#include <tao/json.hpp>
+
+auto
+main() -> int
+{
+    bench::settings config;
+    auto cluster = bench::connect(config);
+    auto collection = cluster.bucket(config.bucket_name).default_collection();
+
+    constexpr std::size_t key_count{ 1'000 };
+    auto key = [](std::size_t i) { return fmt::format("bench-subdoc-{}", i % key_count); };
+    tao::json::value document{
+        { "name", "Benchmark" },
+        { "counter", 0 },
+        { "address", { { "city", "London" }, { "country", "United Kingdom" } } },
+    };
+    for (std::size_t i = 0; i < key_count; ++i) {
+        if (auto [err, result] = collection.upsert(key(i), document).get(); err) {
+            fmt::println("Unable to load benchmark documents: {}", err);
+            return 1;
+        }
+    }
+
+    bench::run("lookup_in", config, [&](std::size_t i) {
+        auto specs = couchbase::lookup_in_specs{
+            couchbase::lookup_in_specs::get("name"),
+            couchbase::lookup_in_specs::get("address.city"),
+        };
+        return collection.lookup_in(key(i), specs).get().first;
+    }).print();
+
+    bench::run("mutate_in", config, [&](std::size_t i) {
+        auto specs = couchbase::mutate_in_specs{
+            couchbase::mutate_in_specs::increment("counter", 1),
+            couchbase::mutate_in_specs::upsert("address.city", "Paris"),
+        };
+        return collection.mutate_in(key(i), specs).get().first;
+    }).print();
+
+    cluster.close().get();
+    return 0;
+}
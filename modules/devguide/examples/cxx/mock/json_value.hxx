@@ -0,0 +1,354 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mock
+{
+// A deliberately small JSON document model: enough to resolve sub-document paths and edit the
+// values they point at. Scalars keep their original JSON text, so numbers and strings round-trip
+// exactly and only the parts of a document that change are re-encoded.
+class json_value
+{
+  public:
+    enum class kind { null, scalar, object, array };
+
+    json_value() = default;
+
+    static auto scalar(std::string text) -> json_value
+    {
+        json_value value;
+        value.kind_ = kind::scalar;
+        value.text_ = std::move(text);
+        return value;
+    }
+
+    static auto object() -> json_value
+    {
+        json_value value;
+        value.kind_ = kind::object;
+        return value;
+    }
+
+    static auto array() -> json_value
+    {
+        json_value value;
+        value.kind_ = kind::array;
+        return value;
+    }
+
+    // `text` as a JSON string literal, quotes included, for splicing into a document.
+    static auto quote(std::string_view text) -> std::string
+    {
+        static constexpr char hex_digits[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(text.size() + 2);
+        out.push_back('"');
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back(c);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                out.append("\\u00");
+                out.push_back(hex_digits[(c >> 4) & 0x0f]);
+                out.push_back(hex_digits[c & 0x0f]);
+            } else {
+                out.push_back(c);
+            }
+        }
+        out.push_back('"');
+        return out;
+    }
+
+    static auto parse(std::string_view text) -> std::optional<json_value>
+    {
+        std::size_t position{ 0 };
+        json_value value;
+        if (!parse_value(text, position, value, 0)) {
+            return std::nullopt;
+        }
+        skip_whitespace(text, position);
+        if (position != text.size()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    auto type() const -> kind
+    {
+        return kind_;
+    }
+
+    // The raw JSON text of a scalar, e.g. `42` or `"text"` (including the quotes).
+    auto text() const -> const std::string&
+    {
+        return text_;
+    }
+
+    auto is_string() const -> bool
+    {
+        return kind_ == kind::scalar && !text_.empty() && text_.front() == '"';
+    }
+
+    auto is_integer() const -> bool
+    {
+        if (kind_ != kind::scalar || text_.empty()) {
+            return false;
+        }
+        for (std::size_t i = text_.front() == '-' ? 1 : 0; i < text_.size(); ++i) {
+            if (text_[i] < '0' || text_[i] > '9') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The unquoted contents of a string scalar. Escape sequences are kept as they are.
+    auto string_contents() const -> std::string
+    {
+        return is_string() ? text_.substr(1, text_.size() - 2) : std::string{};
+    }
+
+    auto members() -> std::vector<std::pair<std::string, json_value>>&
+    {
+        return members_;
+    }
+
+    auto members() const -> const std::vector<std::pair<std::string, json_value>>&
+    {
+        return members_;
+    }
+
+    auto elements() -> std::vector<json_value>&
+    {
+        return elements_;
+    }
+
+    auto elements() const -> const std::vector<json_value>&
+    {
+        return elements_;
+    }
+
+    auto find(std::string_view key) -> json_value*
+    {
+        for (auto& [name, value] : members_) {
+            if (name == key) {
+                return &value;
+            }
+        }
+        return nullptr;
+    }
+
+    auto find(std::string_view key) const -> const json_value*
+    {
+        return const_cast<json_value*>(this)->find(key);
+    }
+
+    // Returns the string member `key`, or `fallback` if there is none.
+    auto string_or(std::string_view key, std::string fallback) const -> std::string
+    {
+        if (const auto* value = find(key); value != nullptr && value->is_string()) {
+            return value->string_contents();
+        }
+        return fallback;
+    }
+
+    auto erase(std::string_view key) -> bool
+    {
+        for (auto it = members_.begin(); it != members_.end(); ++it) {
+            if (it->first == key) {
+                members_.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    auto dump() const -> std::string
+    {
+        std::string out;
+        dump(out);
+        return out;
+    }
+
+    void dump(std::string& out) const
+    {
+        switch (kind_) {
+            case kind::null:
+                out.append("null");
+                break;
+            case kind::scalar:
+                out.append(text_);
+                break;
+            case kind::object:
+                out.push_back('{');
+                for (std::size_t i = 0; i < members_.size(); ++i) {
+                    if (i > 0) {
+                        out.push_back(',');
+                    }
+                    out.push_back('"');
+                    out.append(members_[i].first);
+                    out.append("\":");
+                    members_[i].second.dump(out);
+                }
+                out.push_back('}');
+                break;
+            case kind::array:
+                out.push_back('[');
+                for (std::size_t i = 0; i < elements_.size(); ++i) {
+                    if (i > 0) {
+                        out.push_back(',');
+                    }
+                    elements_[i].dump(out);
+                }
+                out.push_back(']');
+                break;
+        }
+    }
+
+  private:
+    static constexpr std::size_t max_depth{ 64 };
+
+    static void skip_whitespace(std::string_view text, std::size_t& position)
+    {
+        while (position < text.size() &&
+               (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' ||
+                text[position] == '\r')) {
+            ++position;
+        }
+    }
+
+    static auto parse_string(std::string_view text, std::size_t& position, std::string& out)
+      -> bool
+    {
+        auto start = position++;
+        while (position < text.size()) {
+            if (text[position] == '\\') {
+                position += 2;
+            } else if (text[position] == '"') {
+                ++position;
+                out.assign(text.substr(start, position - start));
+                return true;
+            } else {
+                ++position;
+            }
+        }
+        return false;
+    }
+
+    static auto parse_value(
+      std::string_view text,
+      std::size_t& position,
+      json_value& out,
+      std::size_t depth
+    ) -> bool
+    {
+        if (depth > max_depth) {
+            return false;
+        }
+        skip_whitespace(text, position);
+        if (position >= text.size()) {
+            return false;
+        }
+        auto c = text[position];
+        if (c == '{') {
+            out = object();
+            skip_whitespace(text, ++position);
+            if (position < text.size() && text[position] == '}') {
+                ++position;
+                return true;
+            }
+            while (true) {
+                skip_whitespace(text, position);
+                std::string key;
+                if (position >= text.size() || text[position] != '"' ||
+                    !parse_string(text, position, key)) {
+                    return false;
+                }
+                skip_whitespace(text, position);
+                if (position >= text.size() || text[position] != ':') {
+                    return false;
+                }
+                ++position;
+                json_value value;
+                if (!parse_value(text, position, value, depth + 1)) {
+                    return false;
+                }
+                out.members_.emplace_back(key.substr(1, key.size() - 2), std::move(value));
+                skip_whitespace(text, position);
+                if (position < text.size() && text[position] == ',') {
+                    ++position;
+                } else if (position < text.size() && text[position] == '}') {
+                    ++position;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        if (c == '[') {
+            out = array();
+            skip_whitespace(text, ++position);
+            if (position < text.size() && text[position] == ']') {
+                ++position;
+                return true;
+            }
+            while (true) {
+                json_value value;
+                if (!parse_value(text, position, value, depth + 1)) {
+                    return false;
+                }
+                out.elements_.push_back(std::move(value));
+                skip_whitespace(text, position);
+                if (position < text.size() && text[position] == ',') {
+                    ++position;
+                } else if (position < text.size() && text[position] == ']') {
+                    ++position;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        if (c == '"') {
+            std::string raw;
+            if (!parse_string(text, position, raw)) {
+                return false;
+            }
+            out = scalar(std::move(raw));
+            return true;
+        }
+        auto start = position;
+        while (position < text.size() && text[position] != ',' && text[position] != '}' &&
+               text[position] != ']' && text[position] != ' ' && text[position] != '\t' &&
+               text[position] != '\n' && text[position] != '\r') {
+            ++position;
+        }
+        auto token = text.substr(start, position - start);
+        if (token == "null") {
+            out = json_value{};
+            return true;
+        }
+        if (token == "true" || token == "false") {
+            out = scalar(std::string(token));
+            return true;
+        }
+        auto first = token.empty() ? '\0' : token.front();
+        if (!(first == '-' || (first >= '0' && first <= '9'))) {
+            return false;
+        }
+        out = scalar(std::string(token));
+        return true;
+    }
+
+    kind kind_{ kind::null };
+    std::string text_{};
+    std::vector<std::pair<std::string, json_value>> members_{};
+    std::vector<json_value> elements_{};
+};
+} // namespace mock
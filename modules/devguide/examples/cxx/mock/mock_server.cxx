@@ -0,0 +1,1975 @@
+// A single-node mock of Couchbase Server, for running the examples and benchmarks without a
+// cluster. It speaks enough of the memcached binary protocol for the SDK to bootstrap and
+// perform key-value, sub-document and range scan operations, and serves the query, analytics
+// and search HTTP endpoints. Documents are kept in memory; SQL++ is not evaluated -- queries
+// return the stored documents, honouring a LIMIT clause and an $after parameter.
+//
+// Latency, failures and a throughput cap can be injected to reproduce the behaviour of a loaded
+// cluster deterministically. Run with --help for the options.
+
+#include "json_value.hxx"
+#include "scram.hxx"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mock
+{
+struct settings {
+    std::string host{ "127.0.0.1" };
+    std::uint16_t kv_port{ 11210 };
+    std::uint16_t http_port{ 8093 };
+    std::string username{ "Administrator" };
+    std::string password{ "password" };
+    std::uint16_t vbuckets{ 64 };
+    std::size_t default_query_rows{ 100 };
+    std::chrono::microseconds latency{ 0 };
+    double error_rate{ 0.0 };
+    std::uint64_t ops_per_second{ 0 };
+};
+
+// Parses the whole of `text` as a number, or returns std::nullopt if it is not one or is out of
+// range for `Number`. Used for the command line and for everything that arrives from a client,
+// so that malformed input is answered with an error rather than an exception.
+template<typename Number>
+auto
+parse_number(std::string_view text, int base = 10) -> std::optional<Number>
+{
+    Number value{};
+    std::from_chars_result result{};
+    if constexpr (std::is_floating_point_v<Number>) {
+        result = std::from_chars(text.data(), text.data() + text.size(), value);
+    } else {
+        result = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    }
+    auto [end, ec] = result;
+    if (ec != std::errc{} || end != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+auto
+usage(const char* program) -> int
+{
+    std::printf(
+      "Usage: %s [options]\n"
+      "  --host <address>        address to listen on and advertise (default 127.0.0.1)\n"
+      "  --kv-port <port>        key-value port (default 11210)\n"
+      "  --http-port <port>      query, analytics and search port (default 8093)\n"
+      "  --username <name>       user to accept (default Administrator)\n"
+      "  --password <password>   password to accept (default password)\n"
+      "  --vbuckets <count>      number of vBuckets, 1 to 1024 (default 64)\n"
+      "  --query-rows <count>    rows returned by queries without a LIMIT (default 100)\n"
+      "  --latency-us <micros>   delay added to every data operation (default 0)\n"
+      "  --error-rate <0..1>     fraction of data operations failing as temporary (default 0)\n"
+      "  --ops-per-second <n>    cap on data operations per second, 0 for none (default 0)\n",
+      program
+    );
+    return 2;
+}
+
+auto
+parse_arguments(int argc, char** argv) -> std::optional<settings>
+{
+    settings config;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view name{ argv[i] };
+        if (i + 1 >= argc) {
+            return std::nullopt;
+        }
+        std::string_view value{ argv[++i] };
+        if (name == "--host") {
+            config.host = value;
+        } else if (name == "--username") {
+            config.username = value;
+        } else if (name == "--password") {
+            config.password = value;
+        } else if (name == "--kv-port" || name == "--http-port") {
+            auto port = parse_number<std::uint16_t>(value);
+            if (!port || *port == 0) {
+                return std::nullopt;
+            }
+            (name == "--kv-port" ? config.kv_port : config.http_port) = *port;
+        } else if (name == "--vbuckets") {
+            auto vbuckets = parse_number<std::uint16_t>(value);
+            if (!vbuckets || *vbuckets < 1 || *vbuckets > 1024) {
+                return std::nullopt;
+            }
+            config.vbuckets = *vbuckets;
+        } else if (name == "--query-rows") {
+            auto rows = parse_number<std::size_t>(value);
+            if (!rows) {
+                return std::nullopt;
+            }
+            config.default_query_rows = *rows;
+        } else if (name == "--latency-us") {
+            auto latency = parse_number<std::chrono::microseconds::rep>(value);
+            if (!latency || *latency < 0) {
+                return std::nullopt;
+            }
+            config.latency = std::chrono::microseconds(*latency);
+        } else if (name == "--error-rate") {
+            auto rate = parse_number<double>(value);
+            if (!rate || !(*rate >= 0.0 && *rate <= 1.0)) {
+                return std::nullopt;
+            }
+            config.error_rate = *rate;
+        } else if (name == "--ops-per-second") {
+            auto rate = parse_number<std::uint64_t>(value);
+            if (!rate) {
+                return std::nullopt;
+            }
+            config.ops_per_second = *rate;
+        } else {
+            return std::nullopt;
+        }
+    }
+    return config;
+}
+
+// Applies the configured latency, throughput cap and error injection to data operations.
+class fault_injector
+{
+  public:
+    explicit fault_injector(const settings& config)
+      : latency_{ config.latency }
+      , error_rate_{ config.error_rate }
+      , interval_{ config.ops_per_second == 0
+                     ? std::chrono::nanoseconds::zero()
+                     : std::chrono::nanoseconds(1'000'000'000 / config.ops_per_second) }
+    {
+    }
+
+    struct admission {
+        bool fail;
+        std::chrono::steady_clock::time_point due;
+    };
+
+    // Decides whether an operation fails, and when its response is due: after the configured
+    // latency, and no sooner than its slot under the throughput cap. Nothing sleeps here -- the
+    // caller holds the response back until it is due, so that requests pipelined on one
+    // connection wait out their latency together rather than one after another.
+    auto admit() -> admission
+    {
+        auto now = std::chrono::steady_clock::now();
+        admission result{ false, now + latency_ };
+        std::scoped_lock lock(mutex_);
+        if (interval_ != std::chrono::nanoseconds::zero()) {
+            // Each operation reserves the next free slot, spaced `interval_` apart
+            next_slot_ = std::max(next_slot_, now) + interval_;
+            result.due = std::max(result.due, next_slot_);
+        }
+        if (error_rate_ > 0) {
+            result.fail = std::uniform_real_distribution<double>(0, 1)(random_) < error_rate_;
+        }
+        return result;
+    }
+
+  private:
+    std::chrono::microseconds latency_;
+    double error_rate_;
+    std::chrono::nanoseconds interval_;
+    std::mutex mutex_{};
+    std::chrono::steady_clock::time_point next_slot_{};
+    std::mt19937_64 random_{ 42 }; // fixed seed, so that failures are reproducible
+};
+
+struct document {
+    std::string value{};
+    std::uint32_t flags{ 0 };
+    std::uint8_t datatype{ 0 };
+    std::uint64_t cas{ 0 };
+    std::uint64_t seqno{ 0 };
+    std::uint16_t vbucket{ 0 };
+};
+
+// All the documents, ordered by bucket, collection and key, so that range scans are a walk
+// through a contiguous part of the map.
+class store
+{
+  public:
+    using key_type = std::tuple<std::string, std::uint32_t, std::string>;
+
+    explicit store(std::uint16_t vbuckets)
+      : seqnos_(vbuckets, 0)
+    {
+    }
+
+    // Collections are created on first use; the default collection always has ID 0.
+    auto collection_id(const std::string& bucket, const std::string& path) -> std::uint32_t
+    {
+        if (path == "_default._default" || path == "_default" || path.empty()) {
+            return 0;
+        }
+        std::scoped_lock lock(mutex_);
+        auto [it, inserted] = collections_.try_emplace({ bucket, path }, next_collection_id_);
+        if (inserted) {
+            ++next_collection_id_;
+            ++manifest_uid_;
+        }
+        return it->second;
+    }
+
+    // The ID of a collection which has been created already, unlike collection_id(). A bucket's
+    // default collection counts as created once the bucket holds a document.
+    auto find_collection(const std::string& bucket, const std::string& path) const
+      -> std::optional<std::uint32_t>
+    {
+        std::scoped_lock lock(mutex_);
+        if (path == "_default._default") {
+            auto first = documents_.lower_bound({ bucket, 0, std::string{} });
+            if (first == documents_.end() || std::get<0>(first->first) != bucket) {
+                return std::nullopt;
+            }
+            return 0;
+        }
+        auto it = collections_.find({ bucket, path });
+        if (it == collections_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    auto manifest_uid() const -> std::uint64_t
+    {
+        std::scoped_lock lock(mutex_);
+        return manifest_uid_;
+    }
+
+    auto collections(const std::string& bucket) const
+      -> std::vector<std::pair<std::string, std::uint32_t>>
+    {
+        std::scoped_lock lock(mutex_);
+        std::vector<std::pair<std::string, std::uint32_t>> result{ { "_default._default", 0 } };
+        for (const auto& [key, id] : collections_) {
+            if (key.first == bucket) {
+                result.emplace_back(key.second, id);
+            }
+        }
+        return result;
+    }
+
+    auto get(const key_type& key) const -> std::optional<document>
+    {
+        std::scoped_lock lock(mutex_);
+        if (auto it = documents_.find(key); it != documents_.end()) {
+            return it->second;
+        }
+        return std::nullopt;
+    }
+
+    // Runs `mutation` on the current document (or std::nullopt) under the store lock. The
+    // mutation returns a status, and leaves the optional empty to delete the document. On
+    // success, the document gets a new CAS and sequence number.
+    template<typename Mutation>
+    auto mutate(const key_type& key, std::uint16_t vbucket, Mutation&& mutation)
+      -> std::pair<std::uint16_t, document>
+    {
+        std::scoped_lock lock(mutex_);
+        std::optional<document> current;
+        auto it = documents_.find(key);
+        if (it != documents_.end()) {
+            current = it->second;
+        }
+        auto existed = current.has_value();
+        auto status = mutation(current);
+        if (status != 0) {
+            return { status, {} };
+        }
+        // A deleted document is only reported by its new CAS and sequence number
+        document result{};
+        if (current) {
+            result = std::move(*current);
+        } else if (existed) {
+            documents_.erase(it);
+        }
+        result.cas = next_cas();
+        result.seqno = ++seqnos_[vbucket % seqnos_.size()];
+        result.vbucket = vbucket;
+        if (current) {
+            documents_[key] = result;
+        }
+        return { 0, result };
+    }
+
+    // Copies the documents of one vBucket whose keys fall in [from, to), in key order.
+    auto snapshot(
+      const std::string& bucket,
+      std::uint32_t collection,
+      std::uint16_t vbucket,
+      const std::string& from,
+      const std::optional<std::string>& to
+    ) const -> std::vector<std::pair<std::string, document>>
+    {
+        std::scoped_lock lock(mutex_);
+        std::vector<std::pair<std::string, document>> result;
+        for (auto it = documents_.lower_bound({ bucket, collection, from });
+             it != documents_.end() && std::get<0>(it->first) == bucket &&
+             std::get<1>(it->first) == collection;
+             ++it) {
+            const auto& key = std::get<2>(it->first);
+            if (to && key >= *to) {
+                break;
+            }
+            if (it->second.vbucket == vbucket) {
+                result.emplace_back(key, it->second);
+            }
+        }
+        return result;
+    }
+
+    // Up to `limit` documents from every bucket and collection, in key order.
+    auto first(std::size_t limit) const -> std::vector<std::pair<std::string, document>>
+    {
+        std::scoped_lock lock(mutex_);
+        std::vector<std::pair<std::string, document>> result;
+        for (auto it = documents_.begin(); it != documents_.end() && result.size() < limit; ++it) {
+            result.emplace_back(std::get<2>(it->first), it->second);
+        }
+        return result;
+    }
+
+    // Up to `limit` documents of the collection `keyspace` whose key sorts after `after`, in key
+    // order. Without a keyspace they are taken from every bucket and collection.
+    auto after(
+      const std::optional<std::pair<std::string, std::uint32_t>>& keyspace,
+      const std::string& after,
+      std::size_t limit
+    ) const -> std::vector<std::pair<std::string, document>>
+    {
+        std::scoped_lock lock(mutex_);
+        std::vector<std::pair<std::string, document>> result;
+        // Appends up to `limit` documents from one collection, which the map keeps together
+        auto collect = [&](const std::string& bucket, std::uint32_t collection) {
+            std::size_t taken{ 0 };
+            for (auto it = documents_.upper_bound({ bucket, collection, after });
+                 it != documents_.end() && taken < limit && std::get<0>(it->first) == bucket &&
+                 std::get<1>(it->first) == collection;
+                 ++it, ++taken) {
+                result.emplace_back(std::get<2>(it->first), it->second);
+            }
+        };
+        if (keyspace) {
+            collect(keyspace->first, keyspace->second);
+            return result;
+        }
+        for (auto it = documents_.begin(); it != documents_.end();) {
+            auto bucket = std::get<0>(it->first);
+            auto collection = std::get<1>(it->first);
+            collect(bucket, collection);
+            it = documents_.lower_bound({ bucket, collection + 1, std::string{} });
+        }
+        std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+        result.resize(std::min(result.size(), limit));
+        return result;
+    }
+
+  private:
+    auto next_cas() -> std::uint64_t
+    {
+        auto now = static_cast<std::uint64_t>(
+          std::chrono::system_clock::now().time_since_epoch() / std::chrono::nanoseconds(1)
+        );
+        last_cas_ = std::max(last_cas_ + 1, now);
+        return last_cas_;
+    }
+
+    mutable std::mutex mutex_{};
+    std::map<key_type, document> documents_{};
+    std::map<std::pair<std::string, std::string>, std::uint32_t> collections_{};
+    std::uint32_t next_collection_id_{ 8 };
+    std::uint64_t manifest_uid_{ 0 };
+    std::vector<std::uint64_t> seqnos_;
+    std::uint64_t last_cas_{ 0 };
+};
+
+namespace opcode
+{
+constexpr std::uint8_t get{ 0x00 };
+constexpr std::uint8_t upsert{ 0x01 };
+constexpr std::uint8_t insert{ 0x02 };
+constexpr std::uint8_t replace{ 0x03 };
+constexpr std::uint8_t remove{ 0x04 };
+constexpr std::uint8_t noop{ 0x0a };
+constexpr std::uint8_t hello{ 0x1f };
+constexpr std::uint8_t sasl_list_mechs{ 0x20 };
+constexpr std::uint8_t sasl_auth{ 0x21 };
+constexpr std::uint8_t sasl_step{ 0x22 };
+constexpr std::uint8_t select_bucket{ 0x89 };
+constexpr std::uint8_t get_cluster_config{ 0xb5 };
+constexpr std::uint8_t get_collections_manifest{ 0xba };
+constexpr std::uint8_t get_collection_id{ 0xbb };
+constexpr std::uint8_t subdoc_multi_lookup{ 0xd0 };
+constexpr std::uint8_t subdoc_multi_mutation{ 0xd1 };
+constexpr std::uint8_t range_scan_create{ 0xda };
+constexpr std::uint8_t range_scan_continue{ 0xdb };
+constexpr std::uint8_t range_scan_cancel{ 0xdc };
+constexpr std::uint8_t get_error_map{ 0xfe };
+
+// Sub-document operations
+constexpr std::uint8_t subdoc_get{ 0xc5 };
+constexpr std::uint8_t subdoc_exists{ 0xc6 };
+constexpr std::uint8_t subdoc_dict_add{ 0xc7 };
+constexpr std::uint8_t subdoc_dict_upsert{ 0xc8 };
+constexpr std::uint8_t subdoc_remove{ 0xc9 };
+constexpr std::uint8_t subdoc_replace{ 0xca };
+constexpr std::uint8_t subdoc_array_push_last{ 0xcb };
+constexpr std::uint8_t subdoc_array_push_first{ 0xcc };
+constexpr std::uint8_t subdoc_array_insert{ 0xcd };
+constexpr std::uint8_t subdoc_array_add_unique{ 0xce };
+constexpr std::uint8_t subdoc_counter{ 0xcf };
+constexpr std::uint8_t subdoc_get_count{ 0xd2 };
+} // namespace opcode
+
+namespace status
+{
+constexpr std::uint16_t success{ 0x00 };
+constexpr std::uint16_t not_found{ 0x01 };
+constexpr std::uint16_t exists{ 0x02 };
+constexpr std::uint16_t invalid{ 0x04 };
+constexpr std::uint16_t auth_error{ 0x20 };
+constexpr std::uint16_t auth_continue{ 0x21 };
+constexpr std::uint16_t no_access{ 0x24 };
+constexpr std::uint16_t unknown_command{ 0x81 };
+constexpr std::uint16_t temporary_failure{ 0x86 };
+constexpr std::uint16_t range_scan_more{ 0xa6 };
+constexpr std::uint16_t range_scan_complete{ 0xa7 };
+constexpr std::uint16_t subdoc_path_not_found{ 0xc0 };
+constexpr std::uint16_t subdoc_path_mismatch{ 0xc1 };
+constexpr std::uint16_t subdoc_path_invalid{ 0xc2 };
+constexpr std::uint16_t subdoc_value_cannot_insert{ 0xc5 };
+constexpr std::uint16_t subdoc_doc_not_json{ 0xc6 };
+constexpr std::uint16_t subdoc_delta_invalid{ 0xc8 };
+constexpr std::uint16_t subdoc_path_exists{ 0xc9 };
+constexpr std::uint16_t subdoc_multi_path_failure{ 0xcc };
+} // namespace status
+
+// HELLO features the mock supports
+namespace feature
+{
+constexpr std::uint16_t tcp_nodelay{ 0x03 };
+constexpr std::uint16_t mutation_seqno{ 0x04 };
+constexpr std::uint16_t xerror{ 0x07 };
+constexpr std::uint16_t select_bucket{ 0x08 };
+constexpr std::uint16_t json{ 0x0b };
+constexpr std::uint16_t collections{ 0x12 };
+} // namespace feature
+
+constexpr std::uint8_t datatype_json{ 0x01 };
+
+struct packet {
+    std::uint8_t opcode{};
+    std::uint8_t datatype{};
+    std::uint16_t vbucket{};
+    std::uint32_t opaque{};
+    std::uint64_t cas{};
+    std::string extras{};
+    std::string key{};
+    std::string value{};
+};
+
+auto
+read_exact(int fd, char* buffer, std::size_t size) -> bool
+{
+    while (size > 0) {
+        auto received = ::recv(fd, buffer, size, 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer += received;
+        size -= static_cast<std::size_t>(received);
+    }
+    return true;
+}
+
+auto
+write_all(int fd, std::string_view data) -> bool
+{
+    while (!data.empty()) {
+        auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
+}
+
+// Writes the responses for one connection, each no sooner than it is due, in the order they were
+// queued. The connection's reader keeps processing requests in the meantime. Owns the socket, and
+// closes it once the last response has been written.
+class response_writer
+{
+  public:
+    explicit response_writer(int fd)
+      : fd_{ fd }
+      , thread_{ [this] { run(); } }
+    {
+    }
+
+    response_writer(const response_writer&) = delete;
+    auto operator=(const response_writer&) -> response_writer& = delete;
+
+    // Writes out whatever is still queued, then closes the socket.
+    ~response_writer()
+    {
+        {
+            std::scoped_lock lock(mutex_);
+            stopped_ = true;
+            changed_.notify_all();
+        }
+        thread_.join();
+        ::close(fd_);
+    }
+
+    void send(
+      std::string response,
+      std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now()
+    )
+    {
+        std::scoped_lock lock(mutex_);
+        queue_.emplace_back(due, std::move(response));
+        changed_.notify_all();
+    }
+
+    // True once a write has failed, after which the connection is of no further use.
+    auto failed() const -> bool
+    {
+        std::scoped_lock lock(mutex_);
+        return failed_;
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            changed_.wait(lock, [this] { return stopped_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            auto [due, response] = std::move(queue_.front());
+            queue_.pop_front();
+            lock.unlock();
+            std::this_thread::sleep_until(due);
+            auto written = !failed() && write_all(fd_, response);
+            lock.lock();
+            failed_ = failed_ || !written;
+        }
+    }
+
+    int fd_;
+    mutable std::mutex mutex_{};
+    std::condition_variable changed_{};
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> queue_{};
+    bool stopped_{ false };
+    bool failed_{ false };
+    std::thread thread_;
+};
+
+auto
+get_u16(std::string_view data, std::size_t offset) -> std::uint16_t
+{
+    return static_cast<std::uint16_t>(
+      static_cast<std::uint8_t>(data[offset]) << 8 | static_cast<std::uint8_t>(data[offset + 1])
+    );
+}
+
+auto
+get_u32(std::string_view data, std::size_t offset) -> std::uint32_t
+{
+    return static_cast<std::uint32_t>(get_u16(data, offset)) << 16 | get_u16(data, offset + 2);
+}
+
+auto
+get_u64(std::string_view data, std::size_t offset) -> std::uint64_t
+{
+    return static_cast<std::uint64_t>(get_u32(data, offset)) << 32 | get_u32(data, offset + 4);
+}
+
+template<typename Integer>
+void
+put(std::string& out, Integer value)
+{
+    for (int shift = (sizeof(Integer) - 1) * 8; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>((value >> shift) & 0xff));
+    }
+}
+
+void
+put_leb128(std::string& out, std::uint64_t value)
+{
+    do {
+        auto byte = static_cast<std::uint8_t>(value & 0x7f);
+        value >>= 7;
+        out.push_back(static_cast<char>(value == 0 ? byte : byte | 0x80));
+    } while (value != 0);
+}
+
+auto
+read_packet(int fd) -> std::optional<packet>
+{
+    char header[24];
+    if (!read_exact(fd, header, sizeof(header))) {
+        return std::nullopt;
+    }
+    std::string_view view{ header, sizeof(header) };
+    auto magic = static_cast<std::uint8_t>(header[0]);
+    std::size_t framing_length{ 0 };
+    std::size_t key_length{ 0 };
+    if (magic == 0x80) {
+        key_length = get_u16(view, 2);
+    } else if (magic == 0x08) { // alternative request, carrying framing extras
+        framing_length = static_cast<std::uint8_t>(header[2]);
+        key_length = static_cast<std::uint8_t>(header[3]);
+    } else {
+        return std::nullopt;
+    }
+    std::size_t extras_length = static_cast<std::uint8_t>(header[4]);
+    std::size_t body_length = get_u32(view, 8);
+    if (framing_length + extras_length + key_length > body_length) {
+        return std::nullopt;
+    }
+
+    std::string body(body_length, '\0');
+    if (!read_exact(fd, body.data(), body.size())) {
+        return std::nullopt;
+    }
+    packet request;
+    request.opcode = static_cast<std::uint8_t>(header[1]);
+    request.datatype = static_cast<std::uint8_t>(header[5]);
+    request.vbucket = get_u16(view, 6);
+    request.opaque = get_u32(view, 12);
+    request.cas = get_u64(view, 16);
+    request.extras = body.substr(framing_length, extras_length);
+    request.key = body.substr(framing_length + extras_length, key_length);
+    request.value = body.substr(framing_length + extras_length + key_length);
+    return request;
+}
+
+auto
+encode_response(
+  const packet& request,
+  std::uint16_t status,
+  std::string_view extras = {},
+  std::string_view value = {},
+  std::uint64_t cas = 0,
+  std::uint8_t datatype = 0
+) -> std::string
+{
+    std::string out;
+    out.reserve(24 + extras.size() + value.size());
+    out.push_back(static_cast<char>(0x81));
+    out.push_back(static_cast<char>(request.opcode));
+    put<std::uint16_t>(out, 0); // key length
+    out.push_back(static_cast<char>(extras.size()));
+    out.push_back(static_cast<char>(datatype));
+    put<std::uint16_t>(out, status);
+    put<std::uint32_t>(out, static_cast<std::uint32_t>(extras.size() + value.size()));
+    put<std::uint32_t>(out, request.opaque);
+    put<std::uint64_t>(out, cas);
+    out.append(extras);
+    out.append(value);
+    return out;
+}
+
+// A sub-document path, such as `address.lines[0]`, split into member names and array indexes.
+struct path_segment {
+    std::string key{};
+    std::optional<long> index{};
+};
+
+auto
+parse_path(std::string_view path) -> std::optional<std::vector<path_segment>>
+{
+    std::vector<path_segment> segments;
+    std::size_t i{ 0 };
+    while (i < path.size()) {
+        if (path[i] == '[') {
+            auto close = path.find(']', i);
+            if (close == std::string_view::npos || close == i + 1) {
+                return std::nullopt;
+            }
+            try {
+                auto index = std::stol(std::string(path.substr(i + 1, close - i - 1)));
+                segments.push_back({ {}, index });
+            } catch (const std::exception&) {
+                return std::nullopt;
+            }
+            i = close + 1;
+        } else if (path[i] == '`') {
+            auto close = path.find('`', i + 1);
+            if (close == std::string_view::npos) {
+                return std::nullopt;
+            }
+            segments.push_back({ std::string(path.substr(i + 1, close - i - 1)) });
+            i = close + 1;
+        } else {
+            auto end = path.find_first_of(".[", i);
+            if (end == i) {
+                return std::nullopt;
+            }
+            segments.push_back({ std::string(path.substr(i, end - i)) });
+            i = end == std::string_view::npos ? path.size() : end;
+        }
+        if (i < path.size() && path[i] == '.') {
+            ++i;
+        }
+    }
+    return segments;
+}
+
+// Follows `segments` from `root`. When `create` is set, missing objects along the way are added.
+auto
+resolve(
+  json_value& root,
+  const std::vector<path_segment>& segments,
+  std::size_t count,
+  bool create,
+  std::uint16_t& error
+) -> json_value*
+{
+    auto* current = &root;
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& segment = segments[i];
+        if (segment.index) {
+            if (current->type() != json_value::kind::array) {
+                error = status::subdoc_path_mismatch;
+                return nullptr;
+            }
+            auto& elements = current->elements();
+            auto index = *segment.index < 0 ? static_cast<long>(elements.size()) + *segment.index
+                                            : *segment.index;
+            if (index < 0 || index >= static_cast<long>(elements.size())) {
+                error = status::subdoc_path_not_found;
+                return nullptr;
+            }
+            current = &elements[static_cast<std::size_t>(index)];
+        } else {
+            if (current->type() != json_value::kind::object) {
+                error = status::subdoc_path_mismatch;
+                return nullptr;
+            }
+            auto* next = current->find(segment.key);
+            if (next == nullptr) {
+                if (!create) {
+                    error = status::subdoc_path_not_found;
+                    return nullptr;
+                }
+                current->members().emplace_back(segment.key, json_value::object());
+                next = &current->members().back().second;
+            }
+            current = next;
+        }
+    }
+    return current;
+}
+
+// Applies one sub-document mutation spec to `root`, returning its status and, for counters, the
+// resulting value.
+auto
+apply_mutation(
+  json_value& root,
+  std::uint8_t op,
+  bool create_parents,
+  std::string_view path,
+  std::string_view value
+) -> std::pair<std::uint16_t, std::string>
+{
+    auto segments = parse_path(path);
+    if (!segments) {
+        return { status::subdoc_path_invalid, {} };
+    }
+    std::uint16_t error{ status::success };
+
+    if (op == opcode::subdoc_array_push_last || op == opcode::subdoc_array_push_first ||
+        op == opcode::subdoc_array_add_unique) {
+        auto* target = resolve(root, *segments, segments->size(), false, error);
+        if (target == nullptr && error == status::subdoc_path_not_found && create_parents) {
+            target = resolve(root, *segments, segments->size(), true, error);
+            *target = json_value::array();
+        }
+        if (target == nullptr) {
+            return { error, {} };
+        }
+        if (target->type() != json_value::kind::array) {
+            return { status::subdoc_path_mismatch, {} };
+        }
+        // Several values may be pushed at once, separated by commas
+        auto values = json_value::parse("[" + std::string(value) + "]");
+        if (!values) {
+            return { status::subdoc_value_cannot_insert, {} };
+        }
+        auto& elements = target->elements();
+        if (op == opcode::subdoc_array_add_unique) {
+            for (const auto& element : elements) {
+                if (element.dump() == values->elements().front().dump()) {
+                    return { status::subdoc_path_exists, {} };
+                }
+            }
+        }
+        auto position = op == opcode::subdoc_array_push_first ? elements.begin() : elements.end();
+        elements.insert(position, values->elements().begin(), values->elements().end());
+        return { status::success, {} };
+    }
+
+    if (segments->empty()) {
+        return { status::subdoc_path_invalid, {} };
+    }
+    const auto& leaf = segments->back();
+    auto* parent = resolve(root, *segments, segments->size() - 1, create_parents, error);
+    if (parent == nullptr) {
+        return { error, {} };
+    }
+
+    if (op == opcode::subdoc_remove) {
+        if (leaf.index && parent->type() == json_value::kind::array) {
+            auto& elements = parent->elements();
+            auto index = *leaf.index < 0 ? static_cast<long>(elements.size()) + *leaf.index
+                                         : *leaf.index;
+            if (index < 0 || index >= static_cast<long>(elements.size())) {
+                return { status::subdoc_path_not_found, {} };
+            }
+            elements.erase(elements.begin() + index);
+            return { status::success, {} };
+        }
+        if (parent->type() != json_value::kind::object) {
+            return { status::subdoc_path_mismatch, {} };
+        }
+        return { parent->erase(leaf.key) ? status::success : status::subdoc_path_not_found, {} };
+    }
+
+    if (op == opcode::subdoc_array_insert) {
+        if (!leaf.index || parent->type() != json_value::kind::array) {
+            return { status::subdoc_path_mismatch, {} };
+        }
+        auto parsed = json_value::parse(value);
+        auto& elements = parent->elements();
+        if (!parsed) {
+            return { status::subdoc_value_cannot_insert, {} };
+        }
+        if (*leaf.index < 0 || *leaf.index > static_cast<long>(elements.size())) {
+            return { status::subdoc_path_not_found, {} };
+        }
+        elements.insert(elements.begin() + *leaf.index, std::move(*parsed));
+        return { status::success, {} };
+    }
+
+    // The remaining operations set a single value, addressed by the leaf
+    json_value* target{ nullptr };
+    if (leaf.index) {
+        target = resolve(*parent, { leaf }, 1, false, error);
+    } else if (parent->type() == json_value::kind::object) {
+        target = parent->find(leaf.key);
+    } else {
+        return { status::subdoc_path_mismatch, {} };
+    }
+
+    if (op == opcode::subdoc_counter) {
+        long long delta{};
+        try {
+            delta = std::stoll(std::string(value));
+        } catch (const std::exception&) {
+            return { status::subdoc_delta_invalid, {} };
+        }
+        long long current{ 0 };
+        if (target != nullptr) {
+            if (!target->is_integer()) {
+                return { status::subdoc_path_mismatch, {} };
+            }
+            auto number = parse_number<long long>(target->text());
+            if (!number) {
+                return { status::subdoc_path_mismatch, {} };
+            }
+            current = *number;
+        } else if (leaf.index) {
+            return { error, {} };
+        } else {
+            parent->members().emplace_back(leaf.key, json_value{});
+            target = &parent->members().back().second;
+        }
+        auto result = std::to_string(current + delta);
+        *target = json_value::scalar(result);
+        return { status::success, result };
+    }
+
+    auto parsed = json_value::parse(value);
+    if (!parsed) {
+        return { status::subdoc_value_cannot_insert, {} };
+    }
+    switch (op) {
+        case opcode::subdoc_dict_add:
+            if (target != nullptr) {
+                return { status::subdoc_path_exists, {} };
+            }
+            [[fallthrough]];
+        case opcode::subdoc_dict_upsert:
+            if (target == nullptr) {
+                if (leaf.index) {
+                    return { error, {} };
+                }
+                parent->members().emplace_back(leaf.key, std::move(*parsed));
+            } else {
+                *target = std::move(*parsed);
+            }
+            return { status::success, {} };
+        case opcode::subdoc_replace:
+            if (target == nullptr) {
+                return { status::subdoc_path_not_found, {} };
+            }
+            *target = std::move(*parsed);
+            return { status::success, {} };
+        default:
+            return { status::unknown_command, {} };
+    }
+}
+
+struct range_scan {
+    std::string bucket{};
+    bool key_only{ false };
+    std::vector<std::pair<std::string, document>> items{};
+    std::size_t next{ 0 };
+};
+
+class server
+{
+  public:
+    explicit server(settings config)
+      : config_{ std::move(config) }
+      , store_{ config_.vbuckets }
+      , faults_{ config_ }
+    {
+    }
+
+    // Builds the cluster map served over CCCP, for `bucket` or -- before a bucket has been
+    // selected -- for the cluster as a whole.
+    auto cluster_config(const std::string& bucket) const -> std::string
+    {
+        std::string services = "{\"kv\":" + std::to_string(config_.kv_port) +
+                               ",\"mgmt\":" + std::to_string(config_.http_port) +
+                               ",\"n1ql\":" + std::to_string(config_.http_port) +
+                               ",\"fts\":" + std::to_string(config_.http_port) +
+                               ",\"cbas\":" + std::to_string(config_.http_port) + "}";
+        std::string out = "{\"rev\":1,\"revEpoch\":1,\"nodesExt\":[{\"services\":" + services +
+                          ",\"thisNode\":true,\"hostname\":" + json_value::quote(config_.host) +
+                          "}]," + "\"clusterCapabilitiesVer\":[1,0]," +
+                          "\"clusterCapabilities\":{\"n1ql\":[\"enhancedPreparedStatements\"]}";
+        if (!bucket.empty()) {
+            out += ",\"name\":" + json_value::quote(bucket) +
+                   ",\"uuid\":" + json_value::quote(bucket + "-mock") +
+                   ",\"nodeLocator\":\"vbucket\",\"bucketCapabilitiesVer\":\"\"," +
+                   "\"bucketCapabilities\":[\"collections\",\"couchapi\",\"dcp\",\"cbhello\"," +
+                   "\"touch\",\"cccp\",\"nodesExt\",\"rangeScan\"]," +
+                   "\"nodes\":[{\"hostname\":" +
+                   json_value::quote(config_.host + ":" + std::to_string(config_.http_port)) +
+                   ",\"ports\":{\"direct\":" + std::to_string(config_.kv_port) + "}}]," +
+                   "\"vBucketServerMap\":{\"hashAlgorithm\":\"CRC\",\"numReplicas\":0," +
+                   "\"serverList\":[" +
+                   json_value::quote(config_.host + ":" + std::to_string(config_.kv_port)) +
+                   "],\"vBucketMap\":[";
+            for (std::uint16_t i = 0; i < config_.vbuckets; ++i) {
+                out += i == 0 ? "[0]" : ",[0]";
+            }
+            out += "]}";
+        }
+        return out + "}";
+    }
+
+    void serve_kv(int fd)
+    {
+        std::string bucket;
+        bool collections{ false };
+        bool mutation_seqno{ false };
+        std::optional<scram::server_exchange> sasl;
+        bool authenticated{ false };
+
+        response_writer writer(fd);
+        while (!writer.failed()) {
+            auto request = read_packet(fd);
+            if (!request) {
+                break;
+            }
+            // As on a real server, only negotiation and authentication are allowed before SASL
+            // has succeeded
+            if (!authenticated && !allowed_before_authentication(request->opcode)) {
+                writer.send(encode_response(*request, status::no_access));
+                continue;
+            }
+            std::string response;
+            switch (request->opcode) {
+                case opcode::hello: {
+                    std::string accepted;
+                    for (std::size_t i = 0; i + 1 < request->value.size(); i += 2) {
+                        auto requested = get_u16(request->value, i);
+                        switch (requested) {
+                            case feature::collections:
+                                collections = true;
+                                put<std::uint16_t>(accepted, requested);
+                                break;
+                            case feature::mutation_seqno:
+                                mutation_seqno = true;
+                                put<std::uint16_t>(accepted, requested);
+                                break;
+                            case feature::tcp_nodelay:
+                            case feature::xerror:
+                            case feature::select_bucket:
+                            case feature::json:
+                                put<std::uint16_t>(accepted, requested);
+                                break;
+                            default:
+                                break;
+                        }
+                    }
+                    response = encode_response(*request, status::success, {}, accepted);
+                    break;
+                }
+                case opcode::sasl_list_mechs:
+                    response = encode_response(*request, status::success, {}, "SCRAM-SHA1 PLAIN");
+                    break;
+                case opcode::sasl_auth:
+                    if (request->key == "PLAIN") {
+                        // authzid \0 username \0 password
+                        auto credentials = request->value;
+                        auto first = credentials.find('\0');
+                        auto second = credentials.find('\0', first + 1);
+                        auto valid = first != std::string::npos && second != std::string::npos &&
+                                     credentials.substr(first + 1, second - first - 1) ==
+                                       config_.username &&
+                                     credentials.substr(second + 1) == config_.password;
+                        authenticated = valid;
+                        response = encode_response(
+                          *request, valid ? status::success : status::auth_error
+                        );
+                    } else if (request->key == "SCRAM-SHA1") {
+                        sasl.emplace(config_.username, config_.password);
+                        auto nonce = std::to_string(std::random_device{}()) +
+                                     std::to_string(std::random_device{}());
+                        if (auto server_first = sasl->first(request->value, nonce)) {
+                            response =
+                              encode_response(*request, status::auth_continue, {}, *server_first);
+                        } else {
+                            response = encode_response(*request, status::auth_error);
+                        }
+                    } else {
+                        response = encode_response(*request, status::auth_error);
+                    }
+                    break;
+                case opcode::sasl_step:
+                    if (auto server_final = sasl ? sasl->final(request->value) : std::nullopt) {
+                        authenticated = true;
+                        response = encode_response(*request, status::success, {}, *server_final);
+                    } else {
+                        response = encode_response(*request, status::auth_error);
+                    }
+                    break;
+                case opcode::get_error_map:
+                    response = encode_response(
+                      *request,
+                      status::success,
+                      {},
+                      R"({"version":1,"revision":1,"errors":{)"
+                      R"("86":{"name":"ETMPFAIL","desc":"Temporary failure",)"
+                      R"("attrs":["temp","retry-now"]}}})"
+                    );
+                    break;
+                case opcode::select_bucket:
+                    bucket = request->key;
+                    response = encode_response(*request, status::success);
+                    break;
+                case opcode::get_cluster_config:
+                    response = encode_response(
+                      *request, status::success, {}, cluster_config(bucket), 0, datatype_json
+                    );
+                    break;
+                case opcode::get_collections_manifest: {
+                    std::map<std::string, std::string> scopes;
+                    for (const auto& [path, id] : store_.collections(bucket)) {
+                        auto dot = path.find('.');
+                        auto& collections_json = scopes[path.substr(0, dot)];
+                        collections_json += collections_json.empty() ? "" : ",";
+                        collections_json += "{\"name\":" +
+                                            json_value::quote(path.substr(dot + 1)) +
+                                            ",\"uid\":\"" + hex(id) + "\"}";
+                    }
+                    std::string manifest =
+                      "{\"uid\":\"" + hex(store_.manifest_uid()) + "\",\"scopes\":[";
+                    std::uint32_t scope_id{ 0 };
+                    for (const auto& [scope, collections_json] : scopes) {
+                        manifest += scope_id == 0 ? "{" : ",{";
+                        manifest += "\"name\":" + json_value::quote(scope) + ",\"uid\":\"" +
+                                    hex(scope_id) + "\",\"collections\":[" + collections_json +
+                                    "]}";
+                        ++scope_id;
+                    }
+                    manifest += "]}";
+                    response =
+                      encode_response(*request, status::success, {}, manifest, 0, datatype_json);
+                    break;
+                }
+                case opcode::get_collection_id: {
+                    auto path = request->key.empty() ? request->value : request->key;
+                    std::string extras;
+                    put<std::uint64_t>(extras, store_.manifest_uid());
+                    put<std::uint32_t>(extras, store_.collection_id(bucket, path));
+                    response = encode_response(*request, status::success, extras);
+                    break;
+                }
+                case opcode::noop:
+                    response = encode_response(*request, status::success);
+                    break;
+                default: {
+                    auto [fail, due] = faults_.admit();
+                    if (fail) {
+                        response = encode_response(*request, status::temporary_failure);
+                    } else {
+                        response = handle_data(*request, bucket, collections, mutation_seqno);
+                    }
+                    writer.send(std::move(response), due);
+                    continue;
+                }
+            }
+            writer.send(std::move(response));
+        }
+    }
+
+    void serve_http(int fd)
+    {
+        std::string buffer;
+        while (true) {
+            auto header_end = buffer.find("\r\n\r\n");
+            while (header_end == std::string::npos) {
+                char chunk[4096];
+                auto received = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (received <= 0) {
+                    ::close(fd);
+                    return;
+                }
+                buffer.append(chunk, static_cast<std::size_t>(received));
+                header_end = buffer.find("\r\n\r\n");
+            }
+            auto headers = buffer.substr(0, header_end);
+            std::optional<std::size_t> content_length{ 0 };
+            std::string authorization;
+            for (auto position = headers.find("\r\n"); position != std::string::npos;
+                 position = headers.find("\r\n", position + 2)) {
+                auto line_end = headers.find("\r\n", position + 2);
+                auto line = headers.substr(position + 2, line_end - position - 2);
+                std::string name = line.substr(0, line.find(':'));
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                if (name == "content-length") {
+                    auto value = std::string_view(line).substr(line.find(':') + 1);
+                    auto start = value.find_first_not_of(" \t");
+                    content_length = start == std::string_view::npos
+                                       ? std::nullopt
+                                       : parse_number<std::size_t>(value.substr(start));
+                } else if (name == "authorization") {
+                    authorization = line.substr(line.find(':') + 1);
+                }
+            }
+            if (!content_length) {
+                // Without a length the next request cannot be found, so close the connection
+                write_all(fd, http_response(400, "{\"error\":\"invalid Content-Length\"}"));
+                ::close(fd);
+                return;
+            }
+            while (buffer.size() < header_end + 4 + *content_length) {
+                char chunk[4096];
+                auto received = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (received <= 0) {
+                    ::close(fd);
+                    return;
+                }
+                buffer.append(chunk, static_cast<std::size_t>(received));
+            }
+            auto body = buffer.substr(header_end + 4, *content_length);
+            buffer.erase(0, header_end + 4 + *content_length);
+
+            auto request_line = headers.substr(0, headers.find("\r\n"));
+            auto first_space = request_line.find(' ');
+            auto path = request_line.substr(
+              first_space + 1, request_line.find(' ', first_space + 1) - first_space - 1
+            );
+
+            std::pair<int, std::string> reply{ 401, "{\"error\":\"unauthorized\"}" };
+            if (authorized(authorization)) {
+                reply = handle_http(path, body);
+            }
+            if (!write_all(fd, http_response(reply.first, reply.second))) {
+                ::close(fd);
+                return;
+            }
+        }
+    }
+
+    auto kv_port() const -> std::uint16_t
+    {
+        return config_.kv_port;
+    }
+
+    auto http_port() const -> std::uint16_t
+    {
+        return config_.http_port;
+    }
+
+    auto host() const -> const std::string&
+    {
+        return config_.host;
+    }
+
+  private:
+    static auto allowed_before_authentication(std::uint8_t code) -> bool
+    {
+        return code == opcode::hello || code == opcode::sasl_list_mechs ||
+               code == opcode::sasl_auth || code == opcode::sasl_step ||
+               code == opcode::get_error_map || code == opcode::noop;
+    }
+
+    template<typename Integer>
+    static auto hex(Integer value) -> std::string
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%llx", static_cast<unsigned long long>(value));
+        return buffer;
+    }
+
+    // Splits the collection ID (a LEB128 prefix, once collections are enabled) from the key.
+    static auto split_key(const std::string& key, bool collections)
+      -> std::pair<std::uint32_t, std::string>
+    {
+        if (!collections) {
+            return { 0, key };
+        }
+        std::uint32_t id{ 0 };
+        std::size_t i{ 0 };
+        for (int shift = 0; i < key.size(); shift += 7) {
+            auto byte = static_cast<std::uint8_t>(key[i++]);
+            id |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        return { id, key.substr(i) };
+    }
+
+    auto mutation_extras(const document& doc, bool mutation_seqno) const -> std::string
+    {
+        std::string extras;
+        if (mutation_seqno) {
+            put<std::uint64_t>(extras, 0xfeed0000ULL + doc.vbucket); // partition UUID
+            put<std::uint64_t>(extras, doc.seqno);
+        }
+        return extras;
+    }
+
+    auto handle_data(
+      const packet& request,
+      const std::string& bucket,
+      bool collections,
+      bool mutation_seqno
+    ) -> std::string
+    {
+        auto [collection, key] = split_key(request.key, collections);
+        store::key_type store_key{ bucket, collection, key };
+
+        switch (request.opcode) {
+            case opcode::get: {
+                auto doc = store_.get(store_key);
+                if (!doc) {
+                    return encode_response(request, status::not_found);
+                }
+                std::string extras;
+                put<std::uint32_t>(extras, doc->flags);
+                return encode_response(
+                  request, status::success, extras, doc->value, doc->cas, doc->datatype
+                );
+            }
+            case opcode::upsert:
+            case opcode::insert:
+            case opcode::replace: {
+                if (request.extras.size() < 8) {
+                    return encode_response(request, status::invalid);
+                }
+                auto flags = get_u32(request.extras, 0);
+                auto [code, doc] =
+                  store_.mutate(store_key, request.vbucket, [&](std::optional<document>& current) {
+                      if (request.opcode == opcode::insert && current) {
+                          return status::exists;
+                      }
+                      if (request.opcode == opcode::replace && !current) {
+                          return status::not_found;
+                      }
+                      if (request.cas != 0 && (!current || current->cas != request.cas)) {
+                          return current ? status::exists : status::not_found;
+                      }
+                      current = document{ request.value, flags, request.datatype };
+                      return status::success;
+                  });
+                if (code != status::success) {
+                    return encode_response(request, code);
+                }
+                return encode_response(
+                  request, code, mutation_extras(doc, mutation_seqno), {}, doc.cas
+                );
+            }
+            case opcode::remove: {
+                auto [code, doc] =
+                  store_.mutate(store_key, request.vbucket, [&](std::optional<document>& current) {
+                      if (!current) {
+                          return status::not_found;
+                      }
+                      if (request.cas != 0 && current->cas != request.cas) {
+                          return status::exists;
+                      }
+                      current.reset();
+                      return status::success;
+                  });
+                if (code != status::success) {
+                    return encode_response(request, code);
+                }
+                return encode_response(
+                  request, code, mutation_extras(doc, mutation_seqno), {}, doc.cas
+                );
+            }
+            case opcode::subdoc_multi_lookup:
+                return subdoc_lookup(request, store_key);
+            case opcode::subdoc_multi_mutation:
+                return subdoc_mutation(request, store_key, mutation_seqno);
+            case opcode::range_scan_create:
+                return range_scan_create(request, bucket);
+            case opcode::range_scan_continue:
+                return range_scan_continue(request);
+            case opcode::range_scan_cancel: {
+                std::scoped_lock lock(scans_mutex_);
+                scans_.erase(request.extras);
+                return encode_response(request, status::success);
+            }
+            default:
+                return encode_response(request, status::unknown_command);
+        }
+    }
+
+    auto subdoc_lookup(const packet& request, const store::key_type& key) -> std::string
+    {
+        auto doc = store_.get(key);
+        if (!doc) {
+            return encode_response(request, status::not_found);
+        }
+        auto root = json_value::parse(doc->value);
+
+        std::string results;
+        bool failed{ false };
+        for (std::size_t i = 0; i + 4 <= request.value.size();) {
+            auto op = static_cast<std::uint8_t>(request.value[i]);
+            auto flags = static_cast<std::uint8_t>(request.value[i + 1]);
+            auto path_length = get_u16(request.value, i + 2);
+            auto path = request.value.substr(i + 4, path_length);
+            i += 4 + path_length;
+
+            std::uint16_t code{ status::success };
+            std::string value;
+            if ((flags & 0x04) != 0) {
+                code = status::subdoc_path_not_found; // extended attributes are not supported
+            } else if (op == opcode::get && path.empty()) {
+                value = doc->value;
+            } else if (!root) {
+                code = status::subdoc_doc_not_json;
+            } else if (auto segments = parse_path(path); !segments) {
+                code = status::subdoc_path_invalid;
+            } else if (auto* target = resolve(*root, *segments, segments->size(), false, code)) {
+                if (op == opcode::subdoc_get) {
+                    value = target->dump();
+                } else if (op == opcode::subdoc_get_count) {
+                    if (target->type() == json_value::kind::object) {
+                        value = std::to_string(target->members().size());
+                    } else if (target->type() == json_value::kind::array) {
+                        value = std::to_string(target->elements().size());
+                    } else {
+                        code = status::subdoc_path_mismatch;
+                    }
+                }
+            }
+            failed = failed || code != status::success;
+            put<std::uint16_t>(results, code);
+            put<std::uint32_t>(results, static_cast<std::uint32_t>(value.size()));
+            results.append(value);
+        }
+        return encode_response(
+          request,
+          failed ? status::subdoc_multi_path_failure : status::success,
+          {},
+          results,
+          doc->cas
+        );
+    }
+
+    auto subdoc_mutation(const packet& request, const store::key_type& key, bool mutation_seqno)
+      -> std::string
+    {
+        // Extras hold an optional expiry (ignored by the mock) and optional document flags
+        std::uint8_t doc_flags{ 0 };
+        if (request.extras.size() == 1 || request.extras.size() == 5) {
+            doc_flags = static_cast<std::uint8_t>(request.extras.back());
+        }
+        auto create_document = (doc_flags & 0x03) != 0; // mkdoc or add
+        auto must_not_exist = (doc_flags & 0x02) != 0;
+
+        std::string results;
+        std::string failure;
+        auto [code, doc] =
+          store_.mutate(key, request.vbucket, [&](std::optional<document>& current) {
+              if (current && must_not_exist) {
+                  return status::exists;
+              }
+              if (!current && !create_document) {
+                  return status::not_found;
+              }
+              if (request.cas != 0 && (!current || current->cas != request.cas)) {
+                  return current ? status::exists : status::not_found;
+              }
+              auto root = current ? json_value::parse(current->value) : json_value::object();
+              if (!root) {
+                  return status::subdoc_doc_not_json;
+              }
+              bool deleted{ false };
+              std::uint8_t index{ 0 };
+              for (std::size_t i = 0; i + 8 <= request.value.size(); ++index) {
+                  auto op = static_cast<std::uint8_t>(request.value[i]);
+                  auto flags = static_cast<std::uint8_t>(request.value[i + 1]);
+                  auto path_length = get_u16(request.value, i + 2);
+                  auto value_length = get_u32(request.value, i + 4);
+                  auto path = std::string_view(request.value).substr(i + 8, path_length);
+                  auto value =
+                    std::string_view(request.value).substr(i + 8 + path_length, value_length);
+                  i += 8 + path_length + value_length;
+
+                  std::uint16_t spec_status{ status::success };
+                  std::string spec_value;
+                  if ((flags & 0x04) != 0) {
+                      spec_status = status::subdoc_path_invalid; // no extended attributes
+                  } else if (op == opcode::upsert) { // replace the whole document
+                      if (auto parsed = json_value::parse(value)) {
+                          root = std::move(parsed);
+                      } else {
+                          spec_status = status::subdoc_value_cannot_insert;
+                      }
+                  } else if (op == opcode::remove) { // remove the whole document
+                      deleted = true;
+                  } else {
+                      std::tie(spec_status, spec_value) =
+                        apply_mutation(*root, op, (flags & 0x01) != 0, path, value);
+                  }
+                  if (spec_status != status::success) {
+                      failure.push_back(static_cast<char>(index));
+                      put<std::uint16_t>(failure, spec_status);
+                      return status::subdoc_multi_path_failure;
+                  }
+                  if (!spec_value.empty()) {
+                      results.push_back(static_cast<char>(index));
+                      put<std::uint16_t>(results, status::success);
+                      put<std::uint32_t>(results, static_cast<std::uint32_t>(spec_value.size()));
+                      results.append(spec_value);
+                  }
+              }
+              if (deleted) {
+                  current.reset();
+              } else {
+                  current = document{ root->dump(), current ? current->flags : 0, datatype_json };
+              }
+              return status::success;
+          });
+        if (code == status::subdoc_multi_path_failure) {
+            return encode_response(request, code, {}, failure);
+        }
+        if (code != status::success) {
+            return encode_response(request, code);
+        }
+        return encode_response(
+          request, code, mutation_extras(doc, mutation_seqno), results, doc.cas
+        );
+    }
+
+    auto range_scan_create(const packet& request, const std::string& bucket) -> std::string
+    {
+        auto body = json_value::parse(request.value);
+        if (!body) {
+            return encode_response(request, status::invalid);
+        }
+        auto collection = parse_number<std::uint32_t>(body->string_or("collection", "0"), 16);
+        if (!collection) {
+            return encode_response(request, status::invalid);
+        }
+        range_scan scan{ bucket };
+        if (const auto* key_only = body->find("key_only"); key_only != nullptr) {
+            scan.key_only = key_only->text() == "true";
+        }
+
+        auto decode = [](const json_value* range, const char* name) -> std::optional<std::string> {
+            if (range == nullptr || range->find(name) == nullptr) {
+                return std::nullopt;
+            }
+            return scram::base64_decode(range->find(name)->string_contents());
+        };
+        const auto* range = body->find("range");
+        std::string from;
+        std::optional<std::string> to;
+        if (auto start = decode(range, "start")) {
+            from = *start;
+        } else if (auto excl_start = decode(range, "excl_start")) {
+            from = *excl_start + '\0'; // the smallest key after excl_start
+        }
+        if (auto end = decode(range, "end")) {
+            to = *end + '\0'; // the end of the range is inclusive
+        } else if (auto excl_end = decode(range, "excl_end")) {
+            to = *excl_end;
+        }
+        scan.items = store_.snapshot(bucket, *collection, request.vbucket, from, to);
+
+        if (const auto* sampling = body->find("sampling"); sampling != nullptr) {
+            const auto* samples_value = sampling->find("samples");
+            auto samples = samples_value == nullptr
+                             ? std::nullopt
+                             : parse_number<std::size_t>(samples_value->text());
+            std::optional<std::uint64_t> seed{ 0 };
+            if (const auto* seed_value = sampling->find("seed"); seed_value != nullptr) {
+                seed = parse_number<std::uint64_t>(seed_value->text());
+            }
+            if (!samples || !seed) {
+                return encode_response(request, status::invalid);
+            }
+            std::shuffle(scan.items.begin(), scan.items.end(), std::mt19937_64(*seed));
+            scan.items.resize(std::min(scan.items.size(), *samples));
+        }
+        if (scan.items.empty()) {
+            return encode_response(request, status::not_found);
+        }
+
+        std::string uuid;
+        put<std::uint64_t>(uuid, next_scan_id_++);
+        put<std::uint64_t>(uuid, 0x6d6f636b5f736361ULL); // "mock_sca"
+        {
+            std::scoped_lock lock(scans_mutex_);
+            scans_.emplace(uuid, std::move(scan));
+        }
+        return encode_response(request, status::success, {}, uuid);
+    }
+
+    auto range_scan_continue(const packet& request) -> std::string
+    {
+        if (request.extras.size() < 28) {
+            return encode_response(request, status::invalid);
+        }
+        auto uuid = request.extras.substr(0, 16);
+        auto item_limit = get_u32(request.extras, 16);
+        auto byte_limit = get_u32(request.extras, 24);
+
+        std::scoped_lock lock(scans_mutex_);
+        auto it = scans_.find(uuid);
+        if (it == scans_.end()) {
+            return encode_response(request, status::not_found);
+        }
+        auto& scan = it->second;
+        std::string items;
+        std::size_t count{ 0 };
+        while (scan.next < scan.items.size() && (item_limit == 0 || count < item_limit) &&
+               (byte_limit == 0 || items.size() < byte_limit)) {
+            const auto& [key, doc] = scan.items[scan.next++];
+            ++count;
+            if (!scan.key_only) {
+                put<std::uint32_t>(items, doc.flags);
+                put<std::uint32_t>(items, 0); // expiry
+                put<std::uint64_t>(items, doc.seqno);
+                put<std::uint64_t>(items, doc.cas);
+                items.push_back(static_cast<char>(doc.datatype));
+            }
+            put_leb128(items, key.size());
+            items.append(key);
+            if (!scan.key_only) {
+                put_leb128(items, doc.value.size());
+                items.append(doc.value);
+            }
+        }
+        std::string extras;
+        put<std::uint32_t>(extras, scan.key_only ? 1 : 0);
+        auto complete = scan.next >= scan.items.size();
+        if (complete) {
+            scans_.erase(it);
+        }
+        return encode_response(
+          request, complete ? status::range_scan_complete : status::range_scan_more, extras, items
+        );
+    }
+
+    // Finds the number of rows asked for by a "LIMIT n" clause. The limit may also be a named
+    // ($name) or positional ($1) parameter of the request.
+    auto query_limit(const std::string& statement, const json_value& body) const -> std::size_t
+    {
+        std::string upper(statement);
+        std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+        auto position = upper.rfind("LIMIT ");
+        if (position == std::string::npos) {
+            return config_.default_query_rows;
+        }
+        auto start = statement.find_first_not_of(' ', position + 6);
+        auto end = statement.find_first_of(" ;\n\t", start);
+        auto token = statement.substr(start, end == std::string::npos ? end : end - start);
+        try {
+            if (!token.empty() && token.front() == '$') {
+                if (const auto* named = body.find(token); named != nullptr) {
+                    return std::stoul(named->text());
+                }
+                const auto* args = body.find("args");
+                auto index = std::stoul(token.substr(1)) - 1;
+                if (args != nullptr && index < args->elements().size()) {
+                    return std::stoul(args->elements()[index].text());
+                }
+                return config_.default_query_rows;
+            }
+            return std::stoul(token);
+        } catch (const std::exception&) {
+            return config_.default_query_rows;
+        }
+    }
+
+    // The bucket and collection named by the FROM clause of `statement`, with a bare collection
+    // name taken from the query_context, or std::nullopt if the mock does not hold them -- as for
+    // an Analytics dataset.
+    auto query_keyspace(const std::string& statement, const json_value& body) const
+      -> std::optional<std::pair<std::string, std::uint32_t>>
+    {
+        // `a`.b.`c d` -> { "a", "b", "c d" }, up to the first character which ends the path
+        auto path_of = [](std::string_view text) {
+            std::vector<std::string> parts(1);
+            bool quoted{ false };
+            for (char c : text) {
+                if (c == '`') {
+                    quoted = !quoted;
+                } else if (quoted) {
+                    parts.back() += c;
+                } else if (c == '.') {
+                    parts.emplace_back();
+                } else if (std::isspace(static_cast<unsigned char>(c)) || c == ';' || c == ',') {
+                    break;
+                } else {
+                    parts.back() += c;
+                }
+            }
+            return parts;
+        };
+
+        std::string upper(statement);
+        std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+        auto is_space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+        auto from = upper.find("FROM");
+        while (from != std::string::npos &&
+               ((from > 0 && !is_space(upper[from - 1])) ||
+                (from + 4 < upper.size() && !is_space(upper[from + 4])))) {
+            from = upper.find("FROM", from + 4);
+        }
+        if (from == std::string::npos) {
+            return std::nullopt;
+        }
+        auto start = statement.find_first_not_of(" \t\r\n", from + 4);
+        if (start == std::string::npos) {
+            return std::nullopt;
+        }
+        auto path = path_of(std::string_view(statement).substr(start));
+
+        // default:`bucket`.`scope`
+        auto context_text = body.string_or("query_context", "");
+        context_text.erase(0, context_text.find(':') + 1);
+        auto context = context_text.empty() ? std::vector<std::string>{} : path_of(context_text);
+
+        std::string bucket;
+        std::string collection;
+        if (path.size() == 3) {
+            bucket = path[0];
+            collection = path[1] + "." + path[2];
+        } else if (path.size() == 1 && context.size() == 2) {
+            bucket = context[0];
+            collection = context[1] + "." + path[0];
+        } else if (path.size() == 1 && context.empty()) {
+            bucket = path[0];
+            collection = "_default._default";
+        } else {
+            return std::nullopt;
+        }
+        auto id = store_.find_collection(bucket, collection);
+        if (!id) {
+            return std::nullopt;
+        }
+        return std::make_pair(bucket, *id);
+    }
+
+    auto query_response(
+      const json_value& body,
+      const std::string& prepared_name,
+      std::vector<std::string> rows
+    ) -> std::string
+    {
+        std::string results;
+        for (const auto& row : rows) {
+            results += results.empty() ? "" : ",";
+            results += row;
+        }
+        std::string out = "{\"requestID\":\"mock-" + std::to_string(next_request_id_++) +
+                          "\",\"clientContextID\":\"" +
+                          body.string_or("client_context_id", "") + "\"";
+        if (!prepared_name.empty()) {
+            out += ",\"prepared\":" + json_value::quote(prepared_name);
+        }
+        out += ",\"signature\":{\"*\":\"*\"},\"results\":[" + results +
+               "],\"status\":\"success\",\"metrics\":{\"elapsedTime\":\"100us\","
+               "\"executionTime\":\"90us\",\"resultCount\":" +
+               std::to_string(rows.size()) + ",\"resultSize\":" + std::to_string(results.size()) +
+               ",\"processedObjects\":" + std::to_string(rows.size()) + "}}";
+        return out;
+    }
+
+    static auto http_response(int code, const std::string& payload) -> std::string
+    {
+        const char* reason = code == 200   ? " OK"
+                             : code == 400 ? " Bad Request"
+                             : code == 401 ? " Unauthorized"
+                                           : " Error";
+        return "HTTP/1.1 " + std::to_string(code) + reason +
+               "\r\nContent-Type: application/json\r\nContent-Length: " +
+               std::to_string(payload.size()) + "\r\n\r\n" + payload;
+    }
+
+    static auto query_error(int code, const std::string& message) -> std::string
+    {
+        return "{\"requestID\":\"mock\",\"errors\":[{\"code\":" + std::to_string(code) +
+               ",\"msg\":" + json_value::quote(message) + "}],\"status\":\"fatal\"}";
+    }
+
+    // Checks an HTTP Basic "Authorization" header value against the configured credentials.
+    auto authorized(std::string_view authorization) const -> bool
+    {
+        auto start = authorization.find_first_not_of(' ');
+        if (start == std::string_view::npos || authorization.substr(start, 6) != "Basic ") {
+            return false;
+        }
+        auto credentials = scram::base64_decode(authorization.substr(start + 6));
+        return credentials && *credentials == config_.username + ":" + config_.password;
+    }
+
+    auto handle_http(const std::string& path, const std::string& request_body)
+      -> std::pair<int, std::string>
+    {
+        auto body = json_value::parse(request_body).value_or(json_value::object());
+        auto is_query = path.rfind("/query/service", 0) == 0;
+        auto is_analytics = path.rfind("/analytics/service", 0) == 0;
+        auto is_search = path.rfind("/api/", 0) == 0 && path.size() > 6 &&
+                         path.compare(path.size() - 6, 6, "/query") == 0;
+        if (!is_query && !is_analytics && !is_search) {
+            return { 404, "{\"error\":\"not found\"}" };
+        }
+        // HTTP requests are not pipelined, so waiting here holds up only this request
+        auto [fail, due] = faults_.admit();
+        std::this_thread::sleep_until(due);
+        if (fail) {
+            return { 503, query_error(5000, "injected temporary failure") };
+        }
+
+        if (is_search) {
+            std::size_t size{ 10 };
+            if (const auto* value = body.find("size"); value != nullptr) {
+                auto parsed = parse_number<std::size_t>(value->text());
+                if (!parsed) {
+                    return { 400, "{\"error\":\"size must be a non-negative integer\"}" };
+                }
+                size = *parsed;
+            }
+            auto index = path.substr(0, path.size() - 6);
+            index = index.substr(index.rfind('/') + 1);
+            std::string hits;
+            auto documents = store_.first(size);
+            double score = 1.0;
+            for (const auto& [key, doc] : documents) {
+                hits += hits.empty() ? "" : ",";
+                hits += "{\"index\":" + json_value::quote(index) +
+                        ",\"id\":" + json_value::quote(key) +
+                        ",\"score\":" + std::to_string(score) + "}";
+                score *= 0.9;
+            }
+            return { 200,
+                     "{\"status\":{\"total\":1,\"failed\":0,\"successful\":1},\"hits\":[" + hits +
+                       "],\"total_hits\":" + std::to_string(documents.size()) +
+                       ",\"max_score\":1.0,\"took\":100000,\"facets\":{}}" };
+        }
+
+        auto statement = body.string_or("statement", "");
+        std::string prepared_name;
+        // PREPARE [FORCE] name FROM statement, as sent explicitly or by the SDK for adhoc(false)
+        std::string upper(statement);
+        std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+        if (upper.rfind("PREPARE ", 0) == 0) {
+            auto from = upper.find(" FROM ");
+            std::size_t name_start = upper.rfind("PREPARE FORCE ", 0) == 0 ? 14 : 8;
+            if (from == std::string::npos || from <= name_start) {
+                prepared_name = "mock-" + std::to_string(next_request_id_.load());
+            } else {
+                prepared_name = statement.substr(name_start, from - name_start);
+            }
+            prepared_name.erase(
+              std::remove(prepared_name.begin(), prepared_name.end(), '`'), prepared_name.end()
+            );
+            auto prepared_statement = from == std::string::npos ? statement.substr(name_start)
+                                                                : statement.substr(from + 6);
+            {
+                std::scoped_lock lock(prepared_mutex_);
+                prepared_[prepared_name] = prepared_statement;
+            }
+            const auto* auto_execute = body.find("auto_execute");
+            if (auto_execute == nullptr || auto_execute->text() != "true") {
+                auto row = "{\"name\":" + json_value::quote(prepared_name) + "}";
+                return { 200, query_response(body, prepared_name, { row }) };
+            }
+            statement = prepared_statement;
+        } else if (upper.rfind("EXECUTE ", 0) == 0 || body.find("prepared") != nullptr) {
+            auto name = upper.rfind("EXECUTE ", 0) == 0 ? statement.substr(8)
+                                                          : body.string_or("prepared", "");
+            name.erase(std::remove(name.begin(), name.end(), '`'), name.end());
+            std::scoped_lock lock(prepared_mutex_);
+            auto it = prepared_.find(name);
+            if (it == prepared_.end()) {
+                return { 404, query_error(4040, "No such prepared statement: " + name) };
+            }
+            statement = it->second;
+        }
+
+        std::vector<std::string> rows;
+        if (const auto* after = body.find("$after"); after != nullptr && after->is_string()) {
+            // Keyset pagination, as the streaming examples do it: the rows are the documents
+            // whose key sorts after $after, with the key added to each object as "id"
+            auto limit = query_limit(statement, body);
+            auto keyspace = query_keyspace(statement, body);
+            for (const auto& [key, doc] : store_.after(keyspace, after->string_contents(), limit)) {
+                if (doc.value.empty() || doc.value.front() != '{') {
+                    rows.push_back(doc.value);
+                    continue;
+                }
+                auto members = doc.value.find_first_not_of(" \t\r\n", 1);
+                auto empty = members == std::string::npos || doc.value[members] == '}';
+                auto id = "{\"id\":" + json_value::quote(key);
+                rows.push_back(id + (empty ? "}" : "," + doc.value.substr(members)));
+            }
+        } else {
+            for (const auto& [key, doc] : store_.first(query_limit(statement, body))) {
+                rows.push_back(doc.value);
+            }
+        }
+        return { 200, query_response(body, prepared_name, std::move(rows)) };
+    }
+
+    settings config_;
+    store store_;
+    fault_injector faults_;
+    std::mutex scans_mutex_{};
+    std::map<std::string, range_scan> scans_{};
+    std::atomic<std::uint64_t> next_scan_id_{ 1 };
+    std::atomic<std::uint64_t> next_request_id_{ 1 };
+    std::mutex prepared_mutex_{};
+    std::map<std::string, std::string> prepared_{};
+};
+
+auto
+listen_on(const std::string& host, std::uint16_t port) -> int
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int enable{ 1 };
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+        ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        std::perror("Unable to listen");
+        std::exit(1);
+    }
+    return fd;
+}
+
+// Accepts connections on `fd`, serving each one on its own thread.
+void
+accept_loop(int fd, const std::function<void(int)>& serve)
+{
+    auto backoff = std::chrono::milliseconds(1);
+    while (true) {
+        int client = ::accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // Out of descriptors or memory: wait for connections to close rather than spinning
+            std::perror("accept");
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::milliseconds(1'000));
+            continue;
+        }
+        backoff = std::chrono::milliseconds(1);
+        int enable{ 1 };
+        ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        std::thread(serve, client).detach();
+    }
+}
+} // namespace mock
+
+auto
+main(int argc, char** argv) -> int
+{
+    auto config = mock::parse_arguments(argc, argv);
+    if (!config) {
+        return mock::usage(argv[0]);
+    }
+    auto server = std::make_shared<mock::server>(*config);
+    int kv = mock::listen_on(server->host(), server->kv_port());
+    int http = mock::listen_on(server->host(), server->http_port());
+    std::printf(
+      "Mock server listening: couchbase://%s:%u (HTTP services on port %u)\n",
+      server->host().c_str(),
+      server->kv_port(),
+      server->http_port()
+    );
+    std::fflush(stdout);
+
+    std::thread http_thread(
+      [&] { mock::accept_loop(http, [server](int fd) { server->serve_http(fd); }); }
+    );
+    mock::accept_loop(kv, [server](int fd) { server->serve_kv(fd); });
+    http_thread.join();
+    return 0;
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// The pieces of SCRAM-SHA1 (RFC 5802) needed for the server side of the SASL exchange, so that
+// the SDK can authenticate against the mock with its default settings and no TLS.
+namespace mock::scram
+{
+using digest = std::array<std::uint8_t, 20>;
+
+inline auto
+sha1(std::string_view data) -> digest
+{
+    std::uint32_t h[5]{ 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    auto rotate = [](std::uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    };
+
+    std::string message(data);
+    auto bit_length = static_cast<std::uint64_t>(data.size()) * 8;
+    message.push_back(static_cast<char>(0x80));
+    while (message.size() % 64 != 56) {
+        message.push_back('\0');
+    }
+    for (int i = 7; i >= 0; --i) {
+        message.push_back(static_cast<char>((bit_length >> (i * 8)) & 0xff));
+    }
+
+    for (std::size_t chunk = 0; chunk < message.size(); chunk += 64) {
+        std::uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            auto byte = [&](int j) {
+                auto value = static_cast<std::uint8_t>(message[chunk + i * 4 + j]);
+                return static_cast<std::uint32_t>(value);
+            };
+            w[i] = byte(0) << 24 | byte(1) << 16 | byte(2) << 8 | byte(3);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        auto a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            std::uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            auto temp = rotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    digest result{};
+    for (int i = 0; i < 20; ++i) {
+        result[i] = static_cast<std::uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+    }
+    return result;
+}
+
+inline auto
+as_string(const digest& value) -> std::string
+{
+    return { reinterpret_cast<const char*>(value.data()), value.size() };
+}
+
+inline auto
+hmac(std::string_view key, std::string_view data) -> digest
+{
+    std::string block(64, '\0');
+    if (key.size() > block.size()) {
+        auto hashed = as_string(sha1(key));
+        block.replace(0, hashed.size(), hashed);
+    } else {
+        block.replace(0, key.size(), key);
+    }
+    std::string inner(block), outer(block);
+    for (std::size_t i = 0; i < block.size(); ++i) {
+        inner[i] = static_cast<char>(inner[i] ^ 0x36);
+        outer[i] = static_cast<char>(outer[i] ^ 0x5c);
+    }
+    return sha1(outer + as_string(sha1(inner.append(data))));
+}
+
+// PBKDF2-HMAC-SHA1, producing a single block -- which is all SCRAM-SHA1 needs.
+inline auto
+salted_password(std::string_view password, std::string_view salt, std::uint32_t iterations)
+  -> digest
+{
+    auto u = hmac(password, std::string(salt) + std::string("\0\0\0\1", 4));
+    auto result = u;
+    for (std::uint32_t i = 1; i < iterations; ++i) {
+        u = hmac(password, as_string(u));
+        for (std::size_t j = 0; j < result.size(); ++j) {
+            result[j] ^= u[j];
+        }
+    }
+    return result;
+}
+
+inline auto
+base64_encode(std::string_view data) -> std::string
+{
+    static constexpr char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (std::size_t i = 0; i < data.size(); i += 3) {
+        std::uint32_t chunk = static_cast<std::uint8_t>(data[i]) << 16;
+        if (i + 1 < data.size()) {
+            chunk |= static_cast<std::uint8_t>(data[i + 1]) << 8;
+        }
+        if (i + 2 < data.size()) {
+            chunk |= static_cast<std::uint8_t>(data[i + 2]);
+        }
+        out.push_back(alphabet[(chunk >> 18) & 0x3f]);
+        out.push_back(alphabet[(chunk >> 12) & 0x3f]);
+        out.push_back(i + 1 < data.size() ? alphabet[(chunk >> 6) & 0x3f] : '=');
+        out.push_back(i + 2 < data.size() ? alphabet[chunk & 0x3f] : '=');
+    }
+    return out;
+}
+
+inline auto
+base64_decode(std::string_view data) -> std::optional<std::string>
+{
+    auto value_of = [](char c) -> int {
+        if (c >= 'A' && c <= 'Z') {
+            return c - 'A';
+        }
+        if (c >= 'a' && c <= 'z') {
+            return c - 'a' + 26;
+        }
+        if (c >= '0' && c <= '9') {
+            return c - '0' + 52;
+        }
+        if (c == '+') {
+            return 62;
+        }
+        if (c == '/') {
+            return 63;
+        }
+        return -1;
+    };
+    std::string out;
+    std::uint32_t buffer{ 0 };
+    int bits{ 0 };
+    for (char c : data) {
+        if (c == '=') {
+            break;
+        }
+        auto value = value_of(c);
+        if (value < 0) {
+            return std::nullopt;
+        }
+        buffer = (buffer << 6) | static_cast<std::uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((buffer >> bits) & 0xff));
+        }
+    }
+    return out;
+}
+
+// Returns the value of attribute `name` (e.g. 'r' in "r=abc,s=...") in a SCRAM message.
+inline auto
+attribute(std::string_view message, char name) -> std::string
+{
+    std::size_t start{ 0 };
+    while (start < message.size()) {
+        auto end = message.find(',', start);
+        if (end == std::string_view::npos) {
+            end = message.size();
+        }
+        if (end - start >= 2 && message[start] == name && message[start + 1] == '=') {
+            return std::string(message.substr(start + 2, end - start - 2));
+        }
+        start = end + 1;
+    }
+    return {};
+}
+
+// The server side of one SCRAM-SHA1 exchange.
+class server_exchange
+{
+  public:
+    server_exchange(std::string username, std::string password)
+      : username_{ std::move(username) }
+      , password_{ std::move(password) }
+    {
+    }
+
+    // Takes the client-first message ("n,,n=user,r=nonce") and returns the server-first one, or
+    // std::nullopt if the user is unknown.
+    auto first(std::string_view client_first, std::string_view server_nonce)
+      -> std::optional<std::string>
+    {
+        auto bare_start = client_first.find("n=");
+        if (bare_start == std::string_view::npos) {
+            return std::nullopt;
+        }
+        client_first_bare_ = client_first.substr(bare_start);
+        if (attribute(client_first_bare_, 'n') != username_) {
+            return std::nullopt;
+        }
+        nonce_ = attribute(client_first_bare_, 'r') + std::string(server_nonce);
+        server_first_ =
+          "r=" + nonce_ + ",s=" + base64_encode(salt_) + ",i=" + std::to_string(iterations_);
+        return server_first_;
+    }
+
+    // Checks the client's proof, returning the server-final message if it is valid.
+    auto final(std::string_view client_final) -> std::optional<std::string>
+    {
+        auto proof_start = client_final.find(",p=");
+        if (proof_start == std::string_view::npos || attribute(client_final, 'r') != nonce_) {
+            return std::nullopt;
+        }
+        auto proof = base64_decode(client_final.substr(proof_start + 3));
+        auto auth_message = client_first_bare_ + "," + server_first_ + "," +
+                            std::string(client_final.substr(0, proof_start));
+
+        auto salted = as_string(salted_password(password_, salt_, iterations_));
+        auto client_key = hmac(salted, "Client Key");
+        auto client_signature = hmac(as_string(sha1(as_string(client_key))), auth_message);
+        std::string expected(client_key.size(), '\0');
+        for (std::size_t i = 0; i < client_key.size(); ++i) {
+            expected[i] = static_cast<char>(client_key[i] ^ client_signature[i]);
+        }
+        if (!proof || *proof != expected) {
+            return std::nullopt;
+        }
+        auto server_signature = hmac(as_string(hmac(salted, "Server Key")), auth_message);
+        return "v=" + base64_encode(as_string(server_signature));
+    }
+
+  private:
+    static constexpr std::uint32_t iterations_{ 4096 };
+
+    std::string username_;
+    std::string password_;
+    std::string salt_{ "couchbase-mock-salt" };
+    std::string client_first_bare_{};
+    std::string server_first_{};
+    std::string nonce_{};
+};
+} // namespace mock::scram
@@ -1,6 +1,15 @@
 #include <couchbase/cluster.hxx>
 #include <couchbase/fmt/error.hxx>
 
+#include <fmt/format.h>
+#include <tao/json/to_string.hpp>
+#include <tao/json/value.hpp>
+
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+
 static constexpr auto connection_string{ "couchbase://127.0.0.1" };
 static constexpr auto username{ "Administrator" };
 static constexpr auto password{ "password" };
@@ -14,6 +23,149 @@ auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, clu
 auto bucket = cluster.bucket(bucket_name);
 auto collection = bucket.scope(scope_name).collection(collection_name);
 
+// tag::executor[]
+// Runs operations from the callback-based API with at most `max_in_flight` of them outstanding.
+// Submitting while the window is full blocks the caller until a slot frees up (backpressure), so
+// neither the number of pending requests nor the memory they hold can grow without bound.
+class async_executor
+{
+  public:
+    // Groups operations so that the caller can wait for just those operations to complete.
+    class batch
+    {
+      public:
+        template<typename Operation, typename Handler>
+        void submit(Operation&& operation, Handler&& handler)
+        {
+            {
+                std::scoped_lock lock(state_->mutex);
+                ++state_->outstanding;
+            }
+            auto on_complete = [state = state_, handler = std::forward<Handler>(handler)](
+                                 auto err, auto result
+                               ) mutable {
+                handler(std::move(err), std::move(result));
+                std::scoped_lock lock(state->mutex);
+                if (--state->outstanding == 0 && state->sealed) {
+                    state->barrier.set_value();
+                }
+            };
+            executor_.submit(std::forward<Operation>(operation), std::move(on_complete));
+        }
+
+        // No more operations will be added; the future completes once all submitted ones have.
+        auto seal() -> std::future<void>
+        {
+            std::scoped_lock lock(state_->mutex);
+            state_->sealed = true;
+            if (state_->outstanding == 0) {
+                state_->barrier.set_value();
+            }
+            return state_->barrier.get_future();
+        }
+
+      private:
+        friend class async_executor;
+
+        struct state {
+            std::mutex mutex{};
+            std::size_t outstanding{ 0 };
+            bool sealed{ false };
+            std::promise<void> barrier{};
+        };
+
+        explicit batch(async_executor& executor)
+          : executor_{ executor }
+        {
+        }
+
+        async_executor& executor_;
+        std::shared_ptr<state> state_{ std::make_shared<state>() };
+    };
+
+    explicit async_executor(std::size_t max_in_flight)
+      : max_in_flight_{ max_in_flight == 0 ? 1 : max_in_flight }
+    {
+    }
+
+    async_executor(const async_executor&) = delete;
+    auto operator=(const async_executor&) -> async_executor& = delete;
+
+    // Never let a callback outlive the executor (or whatever it captured by reference).
+    ~async_executor()
+    {
+        drain();
+    }
+
+    auto new_batch() -> batch
+    {
+        return batch{ *this };
+    }
+
+    // Waits for a free slot, then calls `operation` with a callback that must be handed to the SDK.
+    // The callback invokes `handler` with the operation's error and result, then releases the slot.
+    template<typename Operation, typename Handler>
+    void submit(Operation&& operation, Handler&& handler)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return in_flight_ < max_in_flight_; });
+            ++in_flight_;
+        }
+        std::forward<Operation>(operation)(wrap(std::forward<Handler>(handler)));
+    }
+
+    // As submit(), but returns false instead of waiting when the window is full.
+    template<typename Operation, typename Handler>
+    auto try_submit(Operation&& operation, Handler&& handler) -> bool
+    {
+        {
+            std::scoped_lock lock(mutex_);
+            if (in_flight_ >= max_in_flight_) {
+                return false;
+            }
+            ++in_flight_;
+        }
+        std::forward<Operation>(operation)(wrap(std::forward<Handler>(handler)));
+        return true;
+    }
+
+    // Blocks until every submitted operation has completed.
+    void drain()
+    {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return in_flight_ == 0; });
+    }
+
+    auto in_flight() const -> std::size_t
+    {
+        std::scoped_lock lock(mutex_);
+        return in_flight_;
+    }
+
+  private:
+    template<typename Handler>
+    auto wrap(Handler&& handler)
+    {
+        return [this, handler = std::forward<Handler>(handler)](auto err, auto result) mutable {
+            handler(std::move(err), std::move(result));
+            {
+                std::scoped_lock lock(mutex_);
+                --in_flight_;
+                // Notify while still holding the lock: once it is released, drain() may return
+                // and the executor, along with cv_, may be destroyed
+                cv_.notify_all();
+            }
+        };
+    }
+
+    const std::size_t max_in_flight_;
+    mutable std::mutex mutex_{};
+    std::condition_variable cv_{};
+    std::size_t in_flight_{ 0 };
+};
+// end::executor[]
+
 int
 main()
 {
@@ -50,4 +202,57 @@ main()
         });
         // end::upsert_callback[]
     }
+
+    {
+        // tag::executor_usage[]
+        async_executor executor(512);
+
+        // KV operations
+        auto writes = executor.new_batch();
+        for (int i = 0; i < 100'000; ++i) {
+            auto id = fmt::format("document-key-{}", i);
+            auto content = tao::json::value{ { "index", i } };
+            writes.submit(
+              [id, content](auto&& callback) {
+                  collection.upsert(id, content, {}, std::move(callback));
+              },
+              [id](couchbase::error err, couchbase::mutation_result) {
+                  if (err) {
+                      fmt::println("Error upserting {}: {}", id, err);
+                  }
+              }
+            );
+        }
+        writes.seal().get();
+
+        // Sub-document and query operations go through the same window
+        auto reads = executor.new_batch();
+        reads.submit(
+          [](auto&& callback) {
+              collection.lookup_in(
+                "document-key-1",
+                couchbase::lookup_in_specs{ couchbase::lookup_in_specs::get("index") },
+                {},
+                std::move(callback)
+              );
+          },
+          [](couchbase::error err, couchbase::lookup_in_result result) {
+              if (!err) {
+                  fmt::println("index: {}", result.content_as<int>(0));
+              }
+          }
+        );
+        reads.submit(
+          [](auto&& callback) {
+              cluster.query("SELECT COUNT(*) AS count FROM `default`", {}, std::move(callback));
+          },
+          [](couchbase::error err, couchbase::query_result result) {
+              if (!err) {
+                  fmt::println("{}", tao::json::to_string(result.rows_as_json().at(0)));
+              }
+          }
+        );
+        reads.seal().get();
+        // end::executor_usage[]
+    }
 }
@@ -0,0 +1,210 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "default" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::bulk-kv[]
+// The outcome of a single operation within a batch, reported in the same order as the input.
+template<typename Result>
+struct bulk_result {
+    std::string id;
+    couchbase::error err;
+    Result result;
+};
+
+// Issues many KV operations through the callback API, keeping at most `max_in_flight` of them
+// outstanding at any time. This keeps the connection pipelines full without letting a large batch
+// queue an unbounded number of requests (and their payloads) in memory.
+class bulk_kv
+{
+  public:
+    explicit bulk_kv(couchbase::collection collection, std::size_t max_in_flight = 128)
+      : collection_{ std::move(collection) }
+      , max_in_flight_{ max_in_flight == 0 ? 1 : max_in_flight }
+    {
+    }
+
+    template<typename Document>
+    auto upsert(
+      const std::vector<std::pair<std::string, Document>>& documents,
+      const couchbase::upsert_options& options = {}
+    ) const -> std::vector<bulk_result<couchbase::mutation_result>>
+    {
+        return run<couchbase::mutation_result>(
+          documents.size(),
+          [&](std::size_t index, auto&& handler) {
+              const auto& [id, document] = documents[index];
+              collection_.upsert(id, document, options, std::move(handler));
+              return id;
+          }
+        );
+    }
+
+    auto get(const std::vector<std::string>& ids, const couchbase::get_options& options = {}) const
+      -> std::vector<bulk_result<couchbase::get_result>>
+    {
+        return run<couchbase::get_result>(ids.size(), [&](std::size_t index, auto&& handler) {
+            collection_.get(ids[index], options, std::move(handler));
+            return ids[index];
+        });
+    }
+
+    auto remove(const std::vector<std::string>& ids, const couchbase::remove_options& options = {})
+      const -> std::vector<bulk_result<couchbase::mutation_result>>
+    {
+        return run<couchbase::mutation_result>(ids.size(), [&](std::size_t index, auto&& handler) {
+            collection_.remove(ids[index], options, std::move(handler));
+            return ids[index];
+        });
+    }
+
+  private:
+    template<typename Result>
+    struct batch_state {
+        std::mutex mutex{};
+        std::condition_variable cv{};
+        std::size_t in_flight{ 0 };
+        std::vector<bulk_result<Result>> results{};
+    };
+
+    // Calls `dispatch(index, handler)` for every index in [0, count), blocking only when the
+    // in-flight window is full, and returns once every handler has been invoked.
+    template<typename Result, typename Dispatch>
+    auto run(std::size_t count, Dispatch&& dispatch) const -> std::vector<bulk_result<Result>>
+    {
+        auto state = std::make_shared<batch_state<Result>>();
+        state->results.resize(count);
+
+        for (std::size_t index = 0; index < count; ++index) {
+            {
+                std::unique_lock lock(state->mutex);
+                state->cv.wait(lock, [&] { return state->in_flight < max_in_flight_; });
+                ++state->in_flight;
+            }
+            auto handler = [state, index](couchbase::error err, Result result) {
+                std::scoped_lock lock(state->mutex);
+                state->results[index].err = std::move(err);
+                state->results[index].result = std::move(result);
+                --state->in_flight;
+                state->cv.notify_all();
+            };
+            auto id = dispatch(index, std::move(handler));
+            std::scoped_lock lock(state->mutex);
+            state->results[index].id = std::move(id);
+        }
+
+        std::unique_lock lock(state->mutex);
+        state->cv.wait(lock, [&] { return state->in_flight == 0; });
+        return std::move(state->results);
+    }
+
+    couchbase::collection collection_;
+    std::size_t max_in_flight_;
+};
+// #end::bulk-kv[]
+
+template<typename Result>
+auto
+count_failures(const std::vector<bulk_result<Result>>& results) -> std::size_t
+{
+    std::size_t failures{ 0 };
+    for (const auto& r : results) {
+        if (r.err) {
+            if (failures < 10) {
+                fmt::println("{}: {}", r.id, r.err);
+            }
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+auto
+main() -> int
+{
+    // #tag::cluster[]
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+    // #end::cluster[]
+
+    constexpr std::size_t number_of_documents{ 10'000 };
+
+    // #tag::bulk-upsert[]
+    std::vector<std::pair<std::string, tao::json::value>> documents;
+    documents.reserve(number_of_documents);
+    for (std::size_t i = 0; i < number_of_documents; ++i) {
+        documents.emplace_back(
+          fmt::format("bulk-doc-{}", i), tao::json::value{ { "type", "bulk" }, { "index", i } }
+        );
+    }
+
+    bulk_kv bulk(collection, 256);
+
+    auto start = std::chrono::steady_clock::now();
+    auto upserted = bulk.upsert(documents);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start
+    );
+    fmt::println(
+      "Upserted {} documents in {} ({} failed)", upserted.size(), elapsed, count_failures(upserted)
+    );
+    // #end::bulk-upsert[]
+
+    // #tag::bulk-get[]
+    std::vector<std::string> ids;
+    ids.reserve(documents.size());
+    for (const auto& [id, document] : documents) {
+        ids.push_back(id);
+    }
+
+    auto fetched = bulk.get(ids);
+    std::size_t missing{ 0 };
+    for (const auto& [id, err, result] : fetched) {
+        if (err.ec() == couchbase::errc::key_value::document_not_found) {
+            ++missing;
+        } else if (!err) {
+            auto content = result.content_as<tao::json::value>();
+            // Process the document...
+        }
+    }
+    fmt::println(
+      "Fetched {} documents ({} missing, {} failed)",
+      fetched.size(),
+      missing,
+      count_failures(fetched) - missing
+    );
+    // #end::bulk-get[]
+
+    // #tag::bulk-remove[]
+    auto removed = bulk.remove(ids);
+    fmt::println("Removed {} documents ({} failed)", removed.size(), count_failures(removed));
+    // #end::bulk-remove[]
+
+    cluster.close().get();
+    return 0;
+}
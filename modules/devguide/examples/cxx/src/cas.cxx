@@ -2,7 +2,21 @@
 #include <couchbase/cluster.hxx>
 #include <couchbase/fmt/error.hxx>
 
+#include <tao/json/value.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
 // end::imports[]
 
 static constexpr auto connection_string{ "couchbase://127.0.0.1" };
@@ -13,11 +27,36 @@ static constexpr auto scope_name{ couchbase::scope::default_name };
 static constexpr auto collection_name{ couchbase::collection::default_name };
 
 auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, couchbase::cluster_options{ username, password }).get();
+// #tag::backoff[]
+// Exponential backoff with "full jitter": the n-th retry waits a random duration between zero and
+// min(max_delay, initial_delay * 2^n). Randomising the whole interval stops writers that collided
+// once from colliding again on the next attempt.
+struct backoff_policy {
+    std::chrono::milliseconds initial_delay{ 1 };
+    std::chrono::milliseconds max_delay{ 100 };
+    std::size_t max_attempts{ 10 };
+
+    auto delay(std::size_t attempt, std::mt19937_64& rng) const -> std::chrono::milliseconds
+    {
+        auto ceiling = initial_delay.count() << std::min<std::size_t>(attempt, 20);
+        ceiling = std::min<std::chrono::milliseconds::rep>(ceiling, max_delay.count());
+        return std::chrono::milliseconds(
+          std::uniform_int_distribution<std::chrono::milliseconds::rep>(0, ceiling)(rng)
+        );
+    }
+};
+// #end::backoff[]
+
 // #tag::loop[]
 int
-casLoop(const couchbase::collection& collection, const std::string& doc_id, int max_retries = 10)
+casLoop(
+  const couchbase::collection& collection,
+  const std::string& doc_id,
+  const backoff_policy& policy = {}
+)
 {
-    for (int i = 0; i < max_retries; i++) {
+    std::mt19937_64 rng{ std::random_device{}() };
+    for (std::size_t i = 0; i < policy.max_attempts; i++) {
         // Get the current document contents
         auto [get_err, get_res] = collection.get(doc_id).get();
 
@@ -35,6 +74,11 @@ casLoop(const couchbase::collection& collection, const std::string& doc_id, int
         if (replace_err) {
             // Check if the error returned is a cas mismatch, if it is, we retry
             if (replace_err.ec() == couchbase::errc::common::cas_mismatch) {
+                // Back off for a random, growing duration so that competing writers spread out,
+                // unless that was the last attempt
+                if (i + 1 < policy.max_attempts) {
+                    std::this_thread::sleep_for(policy.delay(i, rng));
+                }
                 continue;
             }
             // Something else went wrong - fast fail
@@ -49,6 +93,188 @@ casLoop(const couchbase::collection& collection, const std::string& doc_id, int
 }
 // #end::loop[]
 
+// #tag::retry-engine[]
+// Applies read-modify-write updates with CAS, entirely through the callback API. A CAS mismatch
+// schedules the next attempt on a timer after a jittered backoff rather than retrying immediately,
+// so no thread blocks while a key is contended, and many keys can be updated at once.
+class cas_retry_engine
+{
+  public:
+    using mutator = std::function<void(tao::json::value&)>;
+
+    struct outcome {
+        std::string id;
+        couchbase::error err;
+        std::size_t attempts{ 0 };
+        std::size_t conflicts{ 0 };
+    };
+
+    explicit cas_retry_engine(couchbase::collection collection, backoff_policy policy = {})
+      : collection_{ std::move(collection) }
+      , policy_{ policy }
+      , timer_{ [this] { run_timer(); } }
+    {
+    }
+
+    cas_retry_engine(const cas_retry_engine&) = delete;
+    auto operator=(const cas_retry_engine&) -> cas_retry_engine& = delete;
+
+    // Waits for every outstanding update to complete before stopping the timer thread.
+    ~cas_retry_engine()
+    {
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return pending_ == 0; });
+            stopped_ = true;
+            cv_.notify_all();
+        }
+        timer_.join();
+    }
+
+    void update(std::string id, mutator mutate, std::function<void(outcome)> handler)
+    {
+        {
+            std::scoped_lock lock(mutex_);
+            ++pending_;
+        }
+        auto op = std::make_shared<operation>();
+        op->result.id = std::move(id);
+        op->mutate = std::move(mutate);
+        op->handler = std::move(handler);
+        attempt(std::move(op));
+    }
+
+    auto update_all(const std::vector<std::string>& ids, const mutator& mutate)
+      -> std::future<std::vector<outcome>>
+    {
+        struct batch {
+            std::mutex mutex{};
+            std::vector<outcome> outcomes{};
+            std::size_t remaining{ 0 };
+            std::promise<std::vector<outcome>> barrier{};
+        };
+        auto state = std::make_shared<batch>();
+        state->outcomes.resize(ids.size());
+        state->remaining = ids.size();
+        auto fut = state->barrier.get_future();
+        if (ids.empty()) {
+            state->barrier.set_value({});
+            return fut;
+        }
+        for (std::size_t index = 0; index < ids.size(); ++index) {
+            update(ids[index], mutate, [state, index](outcome result) {
+                std::scoped_lock lock(state->mutex);
+                state->outcomes[index] = std::move(result);
+                if (--state->remaining == 0) {
+                    state->barrier.set_value(std::move(state->outcomes));
+                }
+            });
+        }
+        return fut;
+    }
+
+  private:
+    struct operation {
+        outcome result{};
+        mutator mutate{};
+        std::function<void(outcome)> handler{};
+    };
+
+    void attempt(std::shared_ptr<operation> op)
+    {
+        ++op->result.attempts;
+        auto id = op->result.id;
+        collection_.get(id, {}, [this, op](couchbase::error err, couchbase::get_result res) {
+            if (err) {
+                return complete(op, std::move(err));
+            }
+            auto content = res.content_as<tao::json::value>();
+            op->mutate(content);
+            auto id = op->result.id;
+            collection_.replace(
+              id,
+              content,
+              couchbase::replace_options().cas(res.cas()),
+              [this, op](couchbase::error err, couchbase::mutation_result) {
+                  if (err.ec() != couchbase::errc::common::cas_mismatch) {
+                      return complete(op, std::move(err));
+                  }
+                  ++op->result.conflicts;
+                  if (op->result.attempts >= policy_.max_attempts) {
+                      return complete(op, std::move(err));
+                  }
+                  schedule(op);
+              }
+            );
+        });
+    }
+
+    void schedule(std::shared_ptr<operation> op)
+    {
+        {
+            std::scoped_lock lock(mutex_);
+            auto deadline =
+              std::chrono::steady_clock::now() + policy_.delay(op->result.attempts, rng_);
+            timers_.push({ deadline, std::move(op) });
+            cv_.notify_all();
+        }
+    }
+
+    void complete(const std::shared_ptr<operation>& op, couchbase::error err)
+    {
+        op->result.err = std::move(err);
+        op->handler(std::move(op->result));
+        {
+            std::scoped_lock lock(mutex_);
+            --pending_;
+            cv_.notify_all();
+        }
+    }
+
+    // Starts each delayed retry once its deadline passes. The retry itself is asynchronous, so this
+    // thread never waits on the network.
+    void run_timer()
+    {
+        std::unique_lock lock(mutex_);
+        while (!stopped_) {
+            if (timers_.empty()) {
+                cv_.wait(lock);
+                continue;
+            }
+            auto deadline = timers_.top().deadline;
+            if (cv_.wait_until(lock, deadline) == std::cv_status::no_timeout) {
+                continue;
+            }
+            auto op = timers_.top().op;
+            timers_.pop();
+            lock.unlock();
+            attempt(std::move(op));
+            lock.lock();
+        }
+    }
+
+    struct timer_entry {
+        std::chrono::steady_clock::time_point deadline;
+        std::shared_ptr<operation> op;
+
+        auto operator>(const timer_entry& other) const -> bool
+        {
+            return deadline > other.deadline;
+        }
+    };
+
+    couchbase::collection collection_;
+    backoff_policy policy_;
+    std::mutex mutex_{};
+    std::condition_variable cv_{};
+    std::priority_queue<timer_entry, std::vector<timer_entry>, std::greater<>> timers_{};
+    std::mt19937_64 rng_{ std::random_device{}() };
+    std::size_t pending_{ 0 };
+    bool stopped_{ false };
+    std::thread timer_;
+};
+// #end::retry-engine[]
+
 int
 main()
 {
@@ -67,4 +293,52 @@ main()
         }
     }
     // #end::lockAndUnlock[]
+
+    {
+        // #tag::retry-engine-usage[]
+        // Simulate a handful of hot counters, each updated by many concurrent writers
+        std::vector<std::string> hot_keys{ "counter-1", "counter-2", "counter-3" };
+        for (const auto& id : hot_keys) {
+            collection.upsert(id, tao::json::value{ { "visitCount", 0 } }).get();
+        }
+        std::vector<std::string> updates;
+        for (int i = 0; i < 50; ++i) {
+            updates.insert(updates.end(), hot_keys.begin(), hot_keys.end());
+        }
+
+        backoff_policy policy{};
+        policy.max_attempts = 20;
+
+        cas_retry_engine engine(collection, policy);
+        auto increment_visits = [](tao::json::value& content) {
+            content["visitCount"] = content["visitCount"].get_unsigned() + 1;
+        };
+        auto outcomes = engine.update_all(updates, increment_visits).get();
+
+        // Report how hot each key was
+        std::map<std::string, std::pair<std::size_t, std::size_t>> attempts_and_conflicts;
+        std::size_t failed{ 0 };
+        for (const auto& outcome : outcomes) {
+            auto& [attempts, conflicts] = attempts_and_conflicts[outcome.id];
+            attempts += outcome.attempts;
+            conflicts += outcome.conflicts;
+            if (outcome.err) {
+                fmt::println(
+                  "Update of {} gave up after {} attempts: {}",
+                  outcome.id,
+                  outcome.attempts,
+                  outcome.err
+                );
+                ++failed;
+            }
+        }
+        for (const auto& [id, counts] : attempts_and_conflicts) {
+            auto [attempts, conflicts] = counts;
+            fmt::println(
+              "{}: {} attempts, {:.1f}% conflicted", id, attempts, 100.0 * conflicts / attempts
+            );
+        }
+        fmt::println("{} of {} updates failed", failed, outcomes.size());
+        // #end::retry-engine-usage[]
+    }
 }
@@ -0,0 +1,572 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+#include <tao/json/to_string.hpp>
+#include <tao/json/value.hpp>
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <utility>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::task[]
+// A lazily started coroutine producing a T. Awaiting it starts it, and the awaiting coroutine is
+// resumed on whichever thread the task finishes on -- usually one of the SDK's IO threads.
+template<typename T>
+class task
+{
+  public:
+    struct promise_type {
+        std::optional<T> value{};
+        std::exception_ptr exception{};
+        std::coroutine_handle<> continuation{};
+
+        auto get_return_object() -> task
+        {
+            return task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+
+        auto initial_suspend() noexcept -> std::suspend_always
+        {
+            return {};
+        }
+
+        struct final_awaiter {
+            auto await_ready() const noexcept -> bool
+            {
+                return false;
+            }
+
+            auto await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+              -> std::coroutine_handle<>
+            {
+                if (auto continuation = handle.promise().continuation; continuation) {
+                    return continuation;
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+
+        auto final_suspend() noexcept -> final_awaiter
+        {
+            return {};
+        }
+
+        void return_value(T v)
+        {
+            value = std::move(v);
+        }
+
+        void unhandled_exception()
+        {
+            exception = std::current_exception();
+        }
+    };
+
+    task(task&& other) noexcept
+      : handle_{ std::exchange(other.handle_, {}) }
+    {
+    }
+
+    task(const task&) = delete;
+    auto operator=(const task&) -> task& = delete;
+    auto operator=(task&&) -> task& = delete;
+
+    ~task()
+    {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    auto await_ready() const noexcept -> bool
+    {
+        return false;
+    }
+
+    auto await_suspend(std::coroutine_handle<> continuation) noexcept -> std::coroutine_handle<>
+    {
+        handle_.promise().continuation = continuation;
+        return handle_;
+    }
+
+    auto await_resume() -> T
+    {
+        if (handle_.promise().exception) {
+            std::rethrow_exception(handle_.promise().exception);
+        }
+        return std::move(*handle_.promise().value);
+    }
+
+  private:
+    explicit task(std::coroutine_handle<promise_type> handle)
+      : handle_{ handle }
+    {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// A coroutine that starts immediately and owns its own frame.
+struct detached_task {
+    struct promise_type {
+        auto get_return_object() noexcept -> detached_task
+        {
+            return {};
+        }
+
+        auto initial_suspend() noexcept -> std::suspend_never
+        {
+            return {};
+        }
+
+        auto final_suspend() noexcept -> std::suspend_never
+        {
+            return {};
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+// Runs the task to completion without waiting for it.
+template<typename T, typename Handler>
+void
+spawn(task<T> t, Handler handler)
+{
+    [](task<T> t, Handler handler) -> detached_task {
+        handler(co_await std::move(t));
+    }(std::move(t), std::move(handler));
+}
+
+// Blocks the calling thread until the task completes. Intended for the top level of a program only.
+template<typename T>
+auto
+sync_wait(task<T> t) -> T
+{
+    std::promise<T> barrier;
+    auto fut = barrier.get_future();
+    [](task<T> t, std::promise<T>& barrier) -> detached_task {
+        try {
+            barrier.set_value(co_await std::move(t));
+        } catch (...) {
+            barrier.set_exception(std::current_exception());
+        }
+    }(std::move(t), barrier);
+    return fut.get();
+}
+// #end::task[]
+
+// #tag::awaiters[]
+// Suspends the awaiting coroutine, hands a completion callback to `initiate`, and resumes the
+// coroutine directly from that callback. No thread is parked while the operation is in flight.
+template<typename Result, typename Initiate>
+class callback_awaiter
+{
+  public:
+    explicit callback_awaiter(Initiate initiate)
+      : initiate_{ std::move(initiate) }
+    {
+    }
+
+    auto await_ready() const noexcept -> bool
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        // The callback may run (and resume the coroutine, destroying this awaiter) before the
+        // initiating call returns, so move it out of *this and touch nothing afterwards.
+        auto initiate = std::move(initiate_);
+        initiate([this, handle](couchbase::error err, Result result) {
+            err_ = std::move(err);
+            result_ = std::move(result);
+            handle.resume();
+        });
+    }
+
+    auto await_resume() -> std::pair<couchbase::error, Result>
+    {
+        return { std::move(err_), std::move(result_) };
+    }
+
+  private:
+    Initiate initiate_;
+    couchbase::error err_{};
+    Result result_{};
+};
+
+// As callback_awaiter, for operations which report only a couchbase::error.
+template<typename Initiate>
+class error_awaiter
+{
+  public:
+    explicit error_awaiter(Initiate initiate)
+      : initiate_{ std::move(initiate) }
+    {
+    }
+
+    auto await_ready() const noexcept -> bool
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        auto initiate = std::move(initiate_);
+        initiate([this, handle](couchbase::error err) {
+            err_ = std::move(err);
+            handle.resume();
+        });
+    }
+
+    auto await_resume() -> couchbase::error
+    {
+        return std::move(err_);
+    }
+
+  private:
+    Initiate initiate_;
+    couchbase::error err_{};
+};
+
+template<typename Result, typename Initiate>
+auto
+make_awaiter(Initiate initiate)
+{
+    return callback_awaiter<Result, Initiate>{ std::move(initiate) };
+}
+
+namespace coro
+{
+inline auto
+get(const couchbase::collection& collection, std::string id, couchbase::get_options options = {})
+{
+    return make_awaiter<couchbase::get_result>([=, id = std::move(id)](auto&& callback) {
+        collection.get(id, options, std::move(callback));
+    });
+}
+
+template<typename Document>
+auto
+upsert(
+  const couchbase::collection& collection,
+  std::string id,
+  Document document,
+  couchbase::upsert_options options = {}
+)
+{
+    return make_awaiter<couchbase::mutation_result>(
+      [=, id = std::move(id), document = std::move(document)](auto&& callback) {
+          collection.upsert(id, document, options, std::move(callback));
+      }
+    );
+}
+
+template<typename Document>
+auto
+replace(
+  const couchbase::collection& collection,
+  std::string id,
+  Document document,
+  couchbase::replace_options options = {}
+)
+{
+    return make_awaiter<couchbase::mutation_result>(
+      [=, id = std::move(id), document = std::move(document)](auto&& callback) {
+          collection.replace(id, document, options, std::move(callback));
+      }
+    );
+}
+
+inline auto
+lookup_in(
+  const couchbase::collection& collection,
+  std::string id,
+  couchbase::lookup_in_specs specs,
+  couchbase::lookup_in_options options = {}
+)
+{
+    return make_awaiter<couchbase::lookup_in_result>(
+      [=, id = std::move(id), specs = std::move(specs)](auto&& callback) {
+          collection.lookup_in(id, specs, options, std::move(callback));
+      }
+    );
+}
+
+inline auto
+mutate_in(
+  const couchbase::collection& collection,
+  std::string id,
+  couchbase::mutate_in_specs specs,
+  couchbase::mutate_in_options options = {}
+)
+{
+    return make_awaiter<couchbase::mutate_in_result>(
+      [=, id = std::move(id), specs = std::move(specs)](auto&& callback) {
+          collection.mutate_in(id, specs, options, std::move(callback));
+      }
+    );
+}
+
+inline auto
+query(
+  const couchbase::cluster& cluster,
+  std::string statement,
+  couchbase::query_options options = {}
+)
+{
+    return make_awaiter<couchbase::query_result>(
+      [=, statement = std::move(statement)](auto&& callback) {
+          cluster.query(statement, options, std::move(callback));
+      }
+    );
+}
+
+// Transaction operations. The attempt context must outlive the coroutine, which it will as long as
+// the coroutine holds on to the shared_ptr it was given.
+using attempt_context_ptr = std::shared_ptr<couchbase::transactions::async_attempt_context>;
+
+inline auto
+get(const attempt_context_ptr& ctx, const couchbase::collection& collection, std::string id)
+{
+    return make_awaiter<couchbase::transactions::transaction_get_result>(
+      [ctx, collection, id = std::move(id)](auto&& callback) {
+          ctx->get(collection, id, std::move(callback));
+      }
+    );
+}
+
+template<typename Document>
+auto
+insert(
+  const attempt_context_ptr& ctx,
+  const couchbase::collection& collection,
+  std::string id,
+  Document document
+)
+{
+    return make_awaiter<couchbase::transactions::transaction_get_result>(
+      [ctx, collection, id = std::move(id), document = std::move(document)](auto&& callback) {
+          ctx->insert(collection, id, document, std::move(callback));
+      }
+    );
+}
+
+template<typename Document>
+auto
+replace(
+  const attempt_context_ptr& ctx,
+  couchbase::transactions::transaction_get_result doc,
+  Document document
+)
+{
+    return make_awaiter<couchbase::transactions::transaction_get_result>(
+      [ctx, doc = std::move(doc), document = std::move(document)](auto&& callback) {
+          ctx->replace(doc, document, std::move(callback));
+      }
+    );
+}
+
+inline auto
+remove(const attempt_context_ptr& ctx, couchbase::transactions::transaction_get_result doc)
+{
+    auto initiate = [ctx, doc = std::move(doc)](auto&& callback) {
+        ctx->remove(doc, std::move(callback));
+    };
+    return error_awaiter<decltype(initiate)>{ std::move(initiate) };
+}
+
+inline auto
+query(
+  const attempt_context_ptr& ctx,
+  const couchbase::scope& scope,
+  std::string statement,
+  couchbase::transactions::transaction_query_options options = {}
+)
+{
+    return make_awaiter<couchbase::transactions::transaction_query_result>(
+      [ctx, scope, statement = std::move(statement), options](auto&& callback) {
+          ctx->query(scope, statement, options, std::move(callback));
+      }
+    );
+}
+} // namespace coro
+// #end::awaiters[]
+
+// #tag::kv[]
+auto
+touch_visit_count(couchbase::collection collection, std::string id) -> task<couchbase::error>
+{
+    tao::json::value initial{ { "visitCount", 0 } };
+    auto [upsert_err, upsert_res] = co_await coro::upsert(collection, id, initial);
+    if (upsert_err) {
+        co_return upsert_err;
+    }
+
+    auto [get_err, get_res] = co_await coro::get(collection, id);
+    if (get_err) {
+        co_return get_err;
+    }
+
+    auto content = get_res.content_as<tao::json::value>();
+    content["visitCount"] = content["visitCount"].get_unsigned() + 1;
+    auto [replace_err, replace_res] = co_await coro::replace(
+      collection, id, content, couchbase::replace_options().cas(get_res.cas())
+    );
+    if (replace_err) {
+        co_return replace_err;
+    }
+
+    auto specs = couchbase::lookup_in_specs{ couchbase::lookup_in_specs::get("visitCount") };
+    auto [lookup_err, lookup_res] = co_await coro::lookup_in(collection, id, specs);
+    if (!lookup_err) {
+        fmt::println("visitCount is now {}", lookup_res.content_as<std::uint64_t>(0));
+    }
+    co_return lookup_err;
+}
+// #end::kv[]
+
+// #tag::query[]
+auto
+count_airlines(couchbase::cluster cluster) -> task<std::optional<std::uint64_t>>
+{
+    auto [err, result] =
+      co_await coro::query(cluster, "SELECT RAW COUNT(*) FROM `travel-sample`.inventory.airline");
+    if (err) {
+        fmt::println("Error: {}", err);
+        co_return std::nullopt;
+    }
+    co_return result.rows_as_json().at(0).get_unsigned();
+}
+// #end::query[]
+
+// #tag::transaction[]
+auto
+transaction_logic(
+  std::shared_ptr<couchbase::transactions::async_attempt_context> ctx,
+  couchbase::collection collection
+) -> task<couchbase::error>
+{
+    // Each co_await issues the operation and resumes here from the SDK's callback, so the steps
+    // read sequentially without nesting callbacks or blocking a thread on a future.
+    tao::json::value doc_a_content{ { "foo", "bar" } };
+    auto [insert_err, doc_a] = co_await coro::insert(ctx, collection, "doc-a", doc_a_content);
+    if (insert_err) {
+        co_return insert_err;
+    }
+
+    auto [get_err, doc_b] = co_await coro::get(ctx, collection, "doc-b");
+    if (get_err) {
+        co_return get_err;
+    }
+    auto content = doc_b.content_as<tao::json::value>();
+    content["transactions"] = "are awesome";
+    auto [replace_err, replaced] = co_await coro::replace(ctx, doc_b, content);
+    if (replace_err) {
+        co_return replace_err;
+    }
+
+    auto [get_c_err, doc_c] = co_await coro::get(ctx, collection, "doc-c");
+    if (get_c_err) {
+        co_return get_c_err;
+    }
+    co_return co_await coro::remove(ctx, doc_c);
+}
+// #end::transaction[]
+
+auto
+main() -> int
+{
+    auto cluster_options = couchbase::cluster_options(username, password);
+    cluster_options.apply_profile("wan_development");
+    auto [connect_err, cluster] =
+      couchbase::cluster::connect(connection_string, cluster_options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    {
+        // #tag::run-kv[]
+        auto err = sync_wait(touch_visit_count(collection, "coroutine-doc"));
+        if (err) {
+            fmt::println("Error: {}", err);
+        }
+        // #end::run-kv[]
+    }
+
+    {
+        // #tag::run-query[]
+        std::promise<void> done;
+        spawn(count_airlines(cluster), [&done](std::optional<std::uint64_t> count) {
+            if (count) {
+                fmt::println("There are {} airlines", *count);
+            }
+            done.set_value();
+        });
+        // Do other work here...
+        done.get_future().get();
+        // #end::run-query[]
+    }
+
+    {
+        collection.upsert("doc-b", tao::json::value{ { "foo", "bar" } }).get();
+        collection.upsert("doc-c", tao::json::value{ { "foo", "bar" } }).get();
+
+        // #tag::run-transaction[]
+        auto barrier = std::make_shared<
+          std::promise<std::pair<couchbase::error, couchbase::transactions::transaction_result>>>();
+        auto fut = barrier->get_future();
+
+        cluster.transactions()->run(
+          [collection](std::shared_ptr<couchbase::transactions::async_attempt_context> ctx
+          ) -> couchbase::error {
+              // Start the coroutine and return straight away: the transaction waits for the
+              // operations it issues before committing, and fails if any of them fail.
+              spawn(transaction_logic(ctx, collection), [](couchbase::error err) {
+                  if (err) {
+                      fmt::println("Transaction logic failed: {}", err);
+                  }
+              });
+              return {};
+          },
+          [barrier](auto err, auto result) { barrier->set_value({ err, result }); }
+        );
+
+        auto [err, result] = fut.get();
+        if (err) {
+            fmt::println("Transaction finished with error: {}", err);
+        } else {
+            fmt::println("Transaction finished successfully");
+        }
+        // #end::run-transaction[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,277 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "default" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::aggregator[]
+// What to do with a delta whose increment or decrement failed.
+enum class counter_failure_policy {
+    // Count it as lost. A counter is never changed twice by the same event, but may be too low.
+    drop,
+    // Add it back to the pending deltas, so it is sent again with the next flush. A counter is
+    // never too low, but an operation which timed out after it was applied is applied again.
+    requeue,
+};
+
+struct counter_aggregator_options {
+    std::chrono::milliseconds flush_interval{ 100 };
+    std::size_t max_pending_keys{ 10'000 };
+    counter_failure_policy on_failure{ counter_failure_policy::requeue };
+    couchbase::durability_level durability{ couchbase::durability_level::none };
+};
+
+struct counter_aggregator_stats {
+    std::uint64_t events{ 0 };
+    std::uint64_t server_operations{ 0 };
+    std::uint64_t failures{ 0 };
+    std::uint64_t dropped_events{ 0 };
+};
+
+// Adds up counter changes locally and applies the total for each key with a single increment or
+// decrement, every `flush_interval` or as soon as `max_pending_keys` keys are waiting. Millions of
+// +1s per second become one server operation per key per interval.
+//
+// Deltas, and the number of events counted, are kept in several stripes, each with its own lock,
+// and every thread adds to the stripe picked by its thread ID -- so threads counting at the same
+// time rarely wait for each other.
+class counter_aggregator
+{
+  public:
+    counter_aggregator(couchbase::collection collection, counter_aggregator_options options = {})
+      : collection_{ std::move(collection) }
+      , options_{ options }
+      , flusher_{ [this] { run(); } }
+    {
+    }
+
+    counter_aggregator(const counter_aggregator&) = delete;
+    auto operator=(const counter_aggregator&) -> counter_aggregator& = delete;
+
+    // Sends whatever is still pending before returning. Deltas which fail to apply are dropped,
+    // whatever the failure policy, as there is no later flush to send them again.
+    ~counter_aggregator()
+    {
+        {
+            std::scoped_lock lock(flush_mutex_);
+            stopping_ = true;
+        }
+        flush_requested_.notify_all();
+        flusher_.join();
+        flush();
+        for (auto& stripe : stripes_) {
+            std::scoped_lock lock(stripe.mutex);
+            for (const auto& [key, pending] : stripe.deltas) {
+                dropped_events_ += pending.events;
+                fmt::println("Dropped {} events for {}: final flush failed", pending.events, key);
+            }
+        }
+    }
+
+    void add(const std::string& key, std::int64_t delta = 1)
+    {
+        auto thread_hash = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        auto& stripe = stripes_[thread_hash % stripe_count];
+        std::size_t pending_keys;
+        {
+            std::scoped_lock lock(stripe.mutex);
+            auto& pending = stripe.deltas[key];
+            pending.delta += delta;
+            pending.events += 1;
+            stripe.events += 1;
+            pending_keys = stripe.deltas.size();
+        }
+        // A rough check on one stripe is enough to tell the flusher to start early
+        if (pending_keys * stripe_count >= options_.max_pending_keys) {
+            flush_requested_.notify_one();
+        }
+    }
+
+    // Applies all pending deltas, returning once the server has answered for each of them.
+    void flush()
+    {
+        std::unordered_map<std::string, pending_delta> totals;
+        for (auto& stripe : stripes_) {
+            std::unordered_map<std::string, pending_delta> deltas;
+            {
+                std::scoped_lock lock(stripe.mutex);
+                deltas.swap(stripe.deltas);
+            }
+            for (const auto& [key, pending] : deltas) {
+                totals[key].delta += pending.delta;
+                totals[key].events += pending.events;
+            }
+        }
+
+        std::vector<std::future<void>> outstanding;
+        for (const auto& [key, pending] : totals) {
+            if (pending.delta == 0) {
+                continue; // the increments and decrements cancelled each other out
+            }
+            auto barrier = std::make_shared<std::promise<void>>();
+            outstanding.push_back(barrier->get_future());
+            auto handler = [this, key = key, pending = pending, barrier](auto err, auto) {
+                if (err) {
+                    failed(key, pending, err);
+                }
+                barrier->set_value();
+            };
+            server_operations_ += 1;
+            if (pending.delta > 0) {
+                auto delta = static_cast<std::uint64_t>(pending.delta);
+                auto options = couchbase::increment_options()
+                                 .delta(delta)
+                                 .initial(delta)
+                                 .durability(options_.durability);
+                collection_.binary().increment(key, options, std::move(handler));
+            } else {
+                auto options = couchbase::decrement_options()
+                                 .delta(static_cast<std::uint64_t>(-pending.delta))
+                                 .initial(0)
+                                 .durability(options_.durability);
+                collection_.binary().decrement(key, options, std::move(handler));
+            }
+        }
+        for (auto& operation : outstanding) {
+            operation.wait();
+        }
+    }
+
+    auto stats() const -> counter_aggregator_stats
+    {
+        counter_aggregator_stats stats{ 0, server_operations_, failures_, dropped_events_ };
+        for (const auto& stripe : stripes_) {
+            std::scoped_lock lock(stripe.mutex);
+            stats.events += stripe.events;
+        }
+        return stats;
+    }
+
+  private:
+    static constexpr std::size_t stripe_count{ 16 };
+
+    struct pending_delta {
+        std::int64_t delta{ 0 };
+        std::uint64_t events{ 0 };
+    };
+
+    // Each on its own cache line, so that threads adding to different stripes do not slow each
+    // other down.
+    struct alignas(64) stripe {
+        mutable std::mutex mutex{};
+        std::unordered_map<std::string, pending_delta> deltas{};
+        std::uint64_t events{ 0 };
+    };
+
+    void failed(const std::string& key, const pending_delta& pending, const couchbase::error& err)
+    {
+        failures_ += 1;
+        if (options_.on_failure == counter_failure_policy::drop) {
+            dropped_events_ += pending.events;
+            fmt::println("Dropped {} events for {}: {}", pending.events, key, err);
+            return;
+        }
+        auto& stripe = stripes_[std::hash<std::string>{}(key) % stripe_count];
+        std::scoped_lock lock(stripe.mutex);
+        stripe.deltas[key].delta += pending.delta;
+        stripe.deltas[key].events += pending.events;
+    }
+
+    void run()
+    {
+        std::unique_lock lock(flush_mutex_);
+        while (!stopping_) {
+            flush_requested_.wait_for(lock, options_.flush_interval);
+            if (stopping_) {
+                break;
+            }
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    couchbase::collection collection_;
+    counter_aggregator_options options_;
+    std::array<stripe, stripe_count> stripes_{};
+    std::atomic<std::uint64_t> server_operations_{ 0 };
+    std::atomic<std::uint64_t> failures_{ 0 };
+    std::atomic<std::uint64_t> dropped_events_{ 0 };
+    std::mutex flush_mutex_{};
+    std::condition_variable flush_requested_{};
+    bool stopping_{ false };
+    std::thread flusher_;
+};
+// #end::aggregator[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    {
+        // #tag::usage[]
+        counter_aggregator counters(
+          collection,
+          counter_aggregator_options{ std::chrono::milliseconds(50) }
+        );
+
+        // Eight threads each count a million page views, spread over a hundred pages
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 8; ++t) {
+            workers.emplace_back([&counters] {
+                for (int i = 0; i < 1'000'000; ++i) {
+                    counters.add(fmt::format("page-views::{}", i % 100));
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        counters.flush();
+
+        auto stats = counters.stats();
+        fmt::println(
+          "{} events applied with {} server operations ({} failed, {} events dropped)",
+          stats.events,
+          stats.server_operations,
+          stats.failures,
+          stats.dropped_events
+        );
+        // #end::usage[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
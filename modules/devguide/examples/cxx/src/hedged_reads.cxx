@@ -0,0 +1,308 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json/value.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ "inventory" };
+static constexpr auto collection_name{ "airline" };
+
+// #tag::hedged-reader[]
+// The latency of the most recent reads from active nodes, from which the hedging delay is taken.
+class latency_window
+{
+  public:
+    explicit latency_window(std::chrono::microseconds initial)
+      : percentile_{ initial.count() }
+    {
+    }
+
+    void record(std::chrono::microseconds latency)
+    {
+        std::scoped_lock lock(mutex_);
+        samples_[next_ % samples_.size()] = latency.count();
+        ++next_;
+        // Sorting on every read would cost more than it saves; the estimate only needs to follow
+        // changes in the cluster, not individual requests.
+        if (next_ % recompute_every == 0) {
+            std::vector<std::int64_t> sorted(
+              samples_.begin(), samples_.begin() + std::min(next_, samples_.size())
+            );
+            auto rank = sorted.size() * 95 / 100;
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            percentile_ = sorted[rank];
+        }
+    }
+
+    // The 95th percentile of the recorded latencies.
+    auto p95() const -> std::chrono::microseconds
+    {
+        return std::chrono::microseconds{ percentile_.load() };
+    }
+
+  private:
+    static constexpr std::size_t recompute_every{ 64 };
+
+    std::mutex mutex_{};
+    std::array<std::int64_t, 1024> samples_{};
+    std::size_t next_{ 0 };
+    std::atomic<std::int64_t> percentile_;
+};
+
+template<typename Value>
+struct hedged_result {
+    Value value{};
+    bool replica{ false };
+
+    // Whether the value came from the replica read rather than the active node.
+    auto is_replica() const -> bool
+    {
+        return replica;
+    }
+};
+
+struct hedging_stats {
+    std::size_t reads{ 0 };
+    std::size_t hedges{ 0 };
+    std::size_t replica_wins{ 0 };
+};
+
+// Reads from the active node first, and only if it has not answered within the p95 latency of
+// recent active reads, also asks the replicas. Whichever answers successfully first is returned,
+// so a single slow node (during a rebalance, say) costs at most the hedging delay plus a replica
+// round trip instead of the full timeout -- while the extra load on the cluster stays at around
+// 5% of reads.
+class hedged_reader
+{
+  public:
+    explicit hedged_reader(
+      couchbase::collection collection,
+      std::chrono::microseconds minimum_delay = std::chrono::milliseconds(1)
+    )
+      : collection_{ std::move(collection) }
+      , minimum_delay_{ minimum_delay }
+      , latencies_{ std::make_shared<latency_window>(minimum_delay * 10) }
+    {
+    }
+
+    template<typename Document>
+    auto get(const std::string& id) -> std::pair<couchbase::error, hedged_result<Document>>
+    {
+        return read<Document>(
+          [id, collection = collection_](auto&& handler) {
+              collection.get(id, {}, std::move(handler));
+          },
+          [id, collection = collection_](auto&& handler) {
+              collection.get_any_replica(id, {}, std::move(handler));
+          },
+          [](const auto& result) { return result.template content_as<Document>(); }
+        );
+    }
+
+    // `decode` is called with either a lookup_in_result or a lookup_in_replica_result, and turns
+    // it into the value returned to the caller.
+    template<typename Decode>
+    auto lookup_in(const std::string& id, const couchbase::lookup_in_specs& specs, Decode decode)
+    {
+        using value_type = decltype(decode(std::declval<couchbase::lookup_in_result>()));
+        return read<value_type>(
+          [id, specs, collection = collection_](auto&& handler) {
+              collection.lookup_in(id, specs, {}, std::move(handler));
+          },
+          [id, specs, collection = collection_](auto&& handler) {
+              collection.lookup_in_any_replica(id, specs, {}, std::move(handler));
+          },
+          std::move(decode)
+        );
+    }
+
+    // How long a read waits for the active node before it is hedged.
+    auto delay() const -> std::chrono::microseconds
+    {
+        return std::max(minimum_delay_, latencies_->p95());
+    }
+
+    auto stats() const -> hedging_stats
+    {
+        std::scoped_lock lock(mutex_);
+        return stats_;
+    }
+
+  private:
+    template<typename Value>
+    struct race {
+        std::mutex mutex{};
+        std::condition_variable done{};
+        // Decodes the first successful result. It is called on the caller's thread once the race
+        // is over, so that a slow or failing decode never holds up the SDK's IO threads.
+        std::function<Value()> winner{};
+        bool replica_won{ false };
+        std::optional<couchbase::error> active_error{};
+        std::optional<couchbase::error> replica_error{};
+    };
+
+    template<typename Value, typename Active, typename Replica, typename Decode>
+    auto read(Active active, Replica replica, Decode decode)
+      -> std::pair<couchbase::error, hedged_result<Value>>
+    {
+        auto state = std::make_shared<race<Value>>();
+        auto start = std::chrono::steady_clock::now();
+
+        active([state, start, decode, latencies = latencies_](auto err, auto result) {
+            // Slow answers are recorded too, even when the replica has already won: they are
+            // what moves the delay.
+            latencies->record(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start
+            ));
+            std::scoped_lock lock(state->mutex);
+            if (err) {
+                state->active_error = err;
+            } else if (!state->winner) {
+                state->winner = [decode, result = std::move(result)] { return decode(result); };
+            }
+            state->done.notify_all();
+        });
+
+        std::unique_lock lock(state->mutex);
+        auto answered = [&] { return state->winner || state->active_error; };
+        if (state->done.wait_for(lock, delay(), answered)) {
+            lock.unlock();
+            return finish(*state, /* hedged */ false);
+        }
+
+        lock.unlock();
+        replica([state, decode](auto err, auto result) {
+            std::scoped_lock lock(state->mutex);
+            if (err) {
+                state->replica_error = err;
+            } else if (!state->winner) {
+                state->replica_won = result.is_replica();
+                state->winner = [decode, result = std::move(result)] { return decode(result); };
+            }
+            state->done.notify_all();
+        });
+        lock.lock();
+        state->done.wait(lock, [&] {
+            return state->winner || (state->active_error && state->replica_error);
+        });
+        lock.unlock();
+        return finish(*state, /* hedged */ true);
+    }
+
+    // Called once the winner, or both errors, have been recorded; the callback which loses the race
+    // only ever records its own error, so the state can be read without its lock.
+    template<typename Value>
+    auto finish(const race<Value>& state, bool hedged)
+      -> std::pair<couchbase::error, hedged_result<Value>>
+    {
+        {
+            std::scoped_lock lock(mutex_);
+            ++stats_.reads;
+            stats_.hedges += hedged ? 1 : 0;
+            stats_.replica_wins += (state.winner && state.replica_won) ? 1 : 0;
+        }
+        if (!state.winner) {
+            // Both reads failed: report the active node's error, as an unhedged read would have
+            return { *state.active_error, {} };
+        }
+        try {
+            return { {}, hedged_result<Value>{ state.winner(), state.replica_won } };
+        } catch (const std::exception& e) {
+            return { { couchbase::errc::common::decoding_failure, e.what() }, {} };
+        }
+    }
+
+    couchbase::collection collection_;
+    std::chrono::microseconds minimum_delay_;
+    std::shared_ptr<latency_window> latencies_;
+    mutable std::mutex mutex_{};
+    hedging_stats stats_{};
+};
+// #end::hedged-reader[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    hedged_reader reader(collection);
+
+    {
+        // #tag::get[]
+        auto [err, airline] = reader.get<tao::json::value>("airline_10");
+        if (err) {
+            fmt::println("Error: {}", err);
+        } else {
+            fmt::println(
+              "{} (from {})",
+              airline.value["name"].get_string(),
+              airline.is_replica() ? "a replica" : "the active node"
+            );
+        }
+        // #end::get[]
+    }
+
+    {
+        // #tag::lookup-in[]
+        auto [err, country] = reader.lookup_in(
+          "airline_10",
+          couchbase::lookup_in_specs{ couchbase::lookup_in_specs::get("country") },
+          [](const auto& result) { return result.template content_as<std::string>(0); }
+        );
+        if (err) {
+            fmt::println("Error: {}", err);
+        } else {
+            fmt::println("Country: {} Is replica: {}", country.value, country.is_replica());
+        }
+        // #end::lookup-in[]
+    }
+
+    {
+        // #tag::stats[]
+        for (int i = 0; i < 1'000; ++i) {
+            reader.get<tao::json::value>("airline_10");
+        }
+        auto stats = reader.stats();
+        fmt::println(
+          "delay: {}, reads: {}, hedged: {}, answered by a replica: {}",
+          reader.delay(),
+          stats.reads,
+          stats.hedges,
+          stats.replica_wins
+        );
+        // #end::stats[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,302 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json/to_string.hpp>
+#include <tao/json/value.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "default" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::cache[]
+struct hot_key_cache_stats {
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+    std::size_t evictions{ 0 };
+    std::size_t invalidations{ 0 };
+};
+
+// A read-through cache in front of collection::get for the small set of keys that take most of
+// the traffic. Documents are kept for at most `ttl`, and each shard keeps its most recently used
+// `capacity_per_shard` documents. Keys are spread over the shards by hash, each with its own
+// lock, so that readers of different keys rarely contend.
+//
+// Mutations made through the cache invalidate the cached document. The CAS returned by the
+// mutation is remembered, so that a get which was already in flight -- and so returns the older
+// document, with a lower CAS -- cannot put the stale copy back. Mutations made by other clients
+// are only picked up when the cached copy expires: reads are at most `ttl` stale.
+class hot_key_cache
+{
+  public:
+    hot_key_cache(
+      couchbase::collection collection,
+      std::chrono::milliseconds ttl,
+      std::size_t capacity_per_shard = 1'024
+    )
+      : collection_{ std::move(collection) }
+      , ttl_{ ttl }
+      , capacity_per_shard_{ capacity_per_shard }
+    {
+    }
+
+    auto get(const std::string& id) -> std::pair<couchbase::error, couchbase::get_result>
+    {
+        return get(id, ttl_);
+    }
+
+    // Accepts a cached copy only if it was read at most `max_staleness` ago, which lets callers
+    // which need fresher data than the cache's TTL share it with those that do not.
+    auto get(const std::string& id, std::chrono::milliseconds max_staleness)
+      -> std::pair<couchbase::error, couchbase::get_result>
+    {
+        auto& shard = shard_for(id);
+        {
+            std::scoped_lock lock(shard.mutex);
+            auto it = shard.entries.find(id);
+            if (it != shard.entries.end() && it->second.document &&
+                std::chrono::steady_clock::now() - it->second.fetched_at <= max_staleness) {
+                ++hits_;
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second.position);
+                return { {}, *it->second.document };
+            }
+        }
+        ++misses_;
+        auto [err, document] = collection_.get(id, {}).get();
+        if (!err) {
+            store(shard, id, document);
+        }
+        return { err, document };
+    }
+
+    template<typename Document>
+    auto upsert(const std::string& id, const Document& document)
+      -> std::pair<couchbase::error, couchbase::mutation_result>
+    {
+        return invalidate_after(id, collection_.upsert(id, document, {}).get());
+    }
+
+    template<typename Document>
+    auto replace(const std::string& id, const Document& document, couchbase::cas cas = {})
+      -> std::pair<couchbase::error, couchbase::mutation_result>
+    {
+        auto options = couchbase::replace_options().cas(cas);
+        return invalidate_after(id, collection_.replace(id, document, options).get());
+    }
+
+    auto remove(const std::string& id) -> std::pair<couchbase::error, couchbase::mutation_result>
+    {
+        return invalidate_after(id, collection_.remove(id, {}).get());
+    }
+
+    auto stats() const -> hot_key_cache_stats
+    {
+        return { hits_, misses_, evictions_, invalidations_ };
+    }
+
+  private:
+    static constexpr std::size_t shard_count{ 16 };
+
+    struct entry {
+        // Empty once the document has been invalidated, while its CAS is still remembered
+        std::optional<couchbase::get_result> document{};
+        couchbase::cas cas{};
+        std::chrono::steady_clock::time_point fetched_at{};
+        std::list<std::string>::iterator position{};
+    };
+
+    struct shard {
+        std::mutex mutex{};
+        std::list<std::string> lru{}; // most recently used first
+        std::unordered_map<std::string, entry> entries{};
+    };
+
+    auto shard_for(const std::string& id) -> shard&
+    {
+        return shards_[std::hash<std::string>{}(id) % shard_count];
+    }
+
+    void store(shard& shard, const std::string& id, const couchbase::get_result& document)
+    {
+        std::scoped_lock lock(shard.mutex);
+        auto& cached = touch(shard, id);
+        if (cached.cas.value() > document.cas().value()) {
+            // A mutation made through the cache has replaced this version since it was read
+            return;
+        }
+        cached.document = document;
+        cached.cas = document.cas();
+        cached.fetched_at = std::chrono::steady_clock::now();
+    }
+
+    auto invalidate_after(
+      const std::string& id,
+      std::pair<couchbase::error, couchbase::mutation_result> mutation
+    ) -> std::pair<couchbase::error, couchbase::mutation_result>
+    {
+        auto& shard = shard_for(id);
+        std::scoped_lock lock(shard.mutex);
+        if (mutation.first) {
+            // The mutation may still have been applied, so the cached copy can no longer be trusted
+            if (auto it = shard.entries.find(id); it != shard.entries.end()) {
+                ++invalidations_;
+                it->second.document.reset();
+            }
+            return mutation;
+        }
+        auto& cached = touch(shard, id);
+        invalidations_ += cached.document ? 1 : 0;
+        cached.document.reset();
+        cached.cas = mutation.second.cas();
+        return mutation;
+    }
+
+    // Returns the entry for `id`, creating it if needed, and marks it as most recently used.
+    // Must be called with the shard's mutex held.
+    auto touch(shard& shard, const std::string& id) -> entry&
+    {
+        auto [it, inserted] = shard.entries.try_emplace(id);
+        if (!inserted) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.position);
+            return it->second;
+        }
+        shard.lru.push_front(id);
+        it->second.position = shard.lru.begin();
+        if (shard.lru.size() > capacity_per_shard_) {
+            shard.entries.erase(shard.lru.back());
+            shard.lru.pop_back();
+            ++evictions_;
+        }
+        return it->second;
+    }
+
+    couchbase::collection collection_;
+    std::chrono::milliseconds ttl_;
+    std::size_t capacity_per_shard_;
+    std::array<shard, shard_count> shards_{};
+    std::atomic<std::size_t> hits_{ 0 };
+    std::atomic<std::size_t> misses_{ 0 };
+    std::atomic<std::size_t> evictions_{ 0 };
+    std::atomic<std::size_t> invalidations_{ 0 };
+};
+// #end::cache[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    {
+        // #tag::usage[]
+        hot_key_cache cache(collection, std::chrono::seconds(1));
+
+        tao::json::value profile{ { "name", "Alice" }, { "visits", 1 } };
+        if (auto [err, result] = cache.upsert("profile::alice", profile); err) {
+            fmt::println("Error: {}", err);
+        }
+
+        // The first read goes to the server, the second is answered from the cache
+        for (int i = 0; i < 2; ++i) {
+            auto [err, result] = cache.get("profile::alice");
+            if (err) {
+                fmt::println("Error: {}", err);
+                continue;
+            }
+            auto visits = result.content_as<tao::json::value>()["visits"];
+            fmt::println("visits: {}", tao::json::to_string(visits));
+        }
+
+        // Writing through the cache invalidates the cached copy
+        profile["visits"] = 2;
+        cache.upsert("profile::alice", profile);
+
+        // A caller that cannot accept data older than 100ms
+        auto [err, fresh] = cache.get("profile::alice", std::chrono::milliseconds(100));
+        if (!err) {
+            auto visits = fresh.content_as<tao::json::value>()["visits"];
+            fmt::println("visits: {}", tao::json::to_string(visits));
+        }
+        // #end::usage[]
+    }
+
+    {
+        // #tag::benchmark[]
+        // Reads where 90% of the traffic goes to 10 of 1,000 keys, with and without the cache.
+        // Every miss is a request to the server, so the miss count is the load that remains.
+        constexpr int iterations{ 10'000 };
+        constexpr std::size_t hot_keys{ 10 };
+        constexpr std::size_t all_keys{ 1'000 };
+        for (std::size_t i = 0; i < all_keys; ++i) {
+            collection.upsert(fmt::format("hot-key-{}", i), tao::json::value{ { "id", i } }).get();
+        }
+
+        auto key_sequence = [] {
+            std::mt19937 random{ 42 };
+            std::vector<std::string> keys;
+            for (int i = 0; i < iterations; ++i) {
+                auto hot = random() % 10 != 0;
+                keys.push_back(fmt::format("hot-key-{}", random() % (hot ? hot_keys : all_keys)));
+            }
+            return keys;
+        }();
+
+        auto mean_latency = [&](auto&& read) {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& key : key_sequence) {
+                if (auto err = read(key); err) {
+                    fmt::println("Error: {}", err);
+                    break;
+                }
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            return std::chrono::duration_cast<std::chrono::microseconds>(elapsed) / iterations;
+        };
+
+        auto direct = mean_latency([&](const auto& key) {
+            return collection.get(key, {}).get().first;
+        });
+        hot_key_cache cache(collection, std::chrono::seconds(5));
+        auto cached = mean_latency([&](const auto& key) { return cache.get(key).first; });
+
+        auto stats = cache.stats();
+        fmt::println("direct: {} per read, {} server reads", direct, iterations);
+        fmt::println(
+          "cached: {} per read, {} server reads ({} hits, {} evictions)",
+          cached,
+          stats.misses,
+          stats.hits,
+          stats.evictions
+        );
+        // #end::benchmark[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -9,8 +9,12 @@
 #include <fmt/format.h>
 #include <tao/json.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <random>
+#include <thread>
 // #end::imports[]
 
 static constexpr auto connection_string{ "couchbase://127.0.0.1" };
@@ -21,19 +25,40 @@ static constexpr auto scope_name{ couchbase::scope::default_name };
 static constexpr auto collection_name{ couchbase::collection::default_name };
 
 // #tag::replace-retry[]
+// Exponential backoff with "full jitter": the n-th retry waits a random duration between zero and
+// min(max_delay, initial_delay * 2^n). The same policy, with the same defaults, as cas.cxx; each
+// example is a program of its own, so each has its own copy.
+struct backoff_policy {
+    std::chrono::milliseconds initial_delay{ 1 };
+    std::chrono::milliseconds max_delay{ 100 };
+    std::size_t max_attempts{ 10 };
+
+    auto delay(std::size_t attempt, std::mt19937_64& rng) const -> std::chrono::milliseconds
+    {
+        auto ceiling = initial_delay.count() << std::min<std::size_t>(attempt, 20);
+        ceiling = std::min<std::chrono::milliseconds::rep>(ceiling, max_delay.count());
+        return std::chrono::milliseconds(
+          std::uniform_int_distribution<std::chrono::milliseconds::rep>(0, ceiling)(rng)
+        );
+    }
+};
+
 auto
-retry_on_cas_mismatch(std::function<couchbase::error()> op) -> couchbase::error
+retry_on_cas_mismatch(std::function<couchbase::error()> op, const backoff_policy& policy = {})
+  -> couchbase::error
 {
-    while (true) {
+    std::mt19937_64 rng{ std::random_device{}() };
+    for (std::size_t attempt = 1;; ++attempt) {
         // Perform the operation
         auto err = op();
-        if (err.ec() == couchbase::errc::common::cas_mismatch) {
-            // Retry if the couchbase::error wraps a cas_mismatch error code
-            continue;
-        } else {
-            // If success or any other failure, return it
+        if (err.ec() != couchbase::errc::common::cas_mismatch || attempt >= policy.max_attempts) {
+            // If success, any other failure, or we've run out of attempts, return it
             return err;
         }
+        // Retry if the couchbase::error wraps a cas_mismatch error code, but first back off for a
+        // random, growing duration so that competing writers spread out instead of colliding
+        // again straight away. There is no wait after the last attempt, which returns above.
+        std::this_thread::sleep_for(policy.delay(attempt - 1, rng));
     }
 }
 
@@ -0,0 +1,325 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/codec/raw_json_transcoder.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ "inventory" };
+static constexpr auto collection_name{ "airline" };
+
+// #tag::queue[]
+// A bounded multi-producer, multi-consumer queue, after Dmitry Vyukov's design. Each slot carries
+// a sequence number telling producers and consumers whose turn it is, so neither side takes a lock.
+// push() and pop() wait on a condition variable when the queue is full or empty instead of
+// spinning, and only take the lock when there is a thread to wait or to wake.
+template<typename T>
+class bounded_queue
+{
+  public:
+    explicit bounded_queue(std::size_t capacity)
+      : mask_{ round_up_to_power_of_two(capacity) - 1 }
+      , slots_(mask_ + 1)
+    {
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    auto try_push(T& value) -> bool
+    {
+        auto position = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            auto& slot = slots_[position & mask_];
+            auto sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff =
+              static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(
+                      position, position + 1, std::memory_order_relaxed
+                    )) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    auto try_pop() -> std::optional<T>
+    {
+        auto position = head_.load(std::memory_order_relaxed);
+        while (true) {
+            auto& slot = slots_[position & mask_];
+            auto sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff =
+              static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(
+                      position, position + 1, std::memory_order_relaxed
+                    )) {
+                    auto value = std::move(slot.value);
+                    slot.value.reset();
+                    slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+                    return value;
+                }
+            } else if (diff < 0) {
+                return std::nullopt; // empty
+            } else {
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // As try_push(), but waits while the queue is full.
+    void push(T& value)
+    {
+        if (!try_push(value)) {
+            std::unique_lock lock(mutex_);
+            ++producers_waiting_;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            not_full_.wait(lock, [&] { return try_push(value); });
+            --producers_waiting_;
+        }
+        wake(consumers_waiting_, not_empty_);
+    }
+
+    // As try_pop(), but waits while the queue is empty. Returns std::nullopt once the queue is
+    // empty and close() has been called.
+    auto pop() -> std::optional<T>
+    {
+        auto value = try_pop();
+        if (!value) {
+            std::unique_lock lock(mutex_);
+            ++consumers_waiting_;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            not_empty_.wait(lock, [&] { return (value = try_pop()) || closed_; });
+            --consumers_waiting_;
+        }
+        if (value) {
+            wake(producers_waiting_, not_full_);
+        }
+        return value;
+    }
+
+    // Tells consumers that nothing more will be pushed.
+    void close()
+    {
+        std::scoped_lock lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+  private:
+    // Wakes a thread waiting for the change just made, if there is one. A waiter registers itself
+    // before checking the queue and the fences order that against the change, so either the waiter
+    // sees the change or this sees the waiter; taking the lock then ensures that it is waiting.
+    void wake(std::atomic<std::size_t>& waiting, std::condition_variable& cv)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) > 0) {
+            std::scoped_lock lock(mutex_);
+            cv.notify_one();
+        }
+    }
+
+    struct slot {
+        std::atomic<std::size_t> sequence{ 0 };
+        std::optional<T> value{};
+    };
+
+    static auto round_up_to_power_of_two(std::size_t n) -> std::size_t
+    {
+        std::size_t result{ 2 };
+        while (result < n) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const std::size_t mask_;
+    std::vector<slot> slots_;
+    alignas(64) std::atomic<std::size_t> tail_{ 0 };
+    alignas(64) std::atomic<std::size_t> head_{ 0 };
+    std::mutex mutex_{};
+    std::condition_variable not_full_{};
+    std::condition_variable not_empty_{};
+    std::atomic<std::size_t> producers_waiting_{ 0 };
+    std::atomic<std::size_t> consumers_waiting_{ 0 };
+    bool closed_{ false };
+};
+// #end::queue[]
+
+// #tag::partitions[]
+// Splits the keys starting with `prefix` into `count` contiguous ranges, using the character that
+// follows the prefix as the split point. Together the ranges cover every key with the prefix,
+// whatever the key distribution; the boundaries (spread over the characters typically found in
+// document IDs) only affect how evenly the work is balanced.
+auto
+split_key_space(const std::string& prefix, std::size_t count) -> std::vector<couchbase::range_scan>
+{
+    // The highest valid UTF-8 code point, which sorts after any key
+    static const std::string max_suffix{ "\xf4\x8f\xbf\xbf" };
+    constexpr unsigned char first{ '0' };
+    constexpr unsigned char last{ 'z' };
+
+    count = std::max<std::size_t>(1, std::min<std::size_t>(count, last - first));
+    std::vector<couchbase::range_scan> ranges;
+    std::optional<couchbase::scan_term> from{ couchbase::scan_term{ prefix } };
+    for (std::size_t i = 1; i < count; ++i) {
+        auto boundary = prefix + static_cast<char>(first + (last - first) * i / count);
+        ranges.emplace_back(from, couchbase::scan_term{ boundary, /* exclusive */ true });
+        from = couchbase::scan_term{ boundary };
+    }
+    ranges.emplace_back(from, couchbase::scan_term{ prefix + max_suffix });
+    return ranges;
+}
+// #end::partitions[]
+
+// #tag::parallel-scan[]
+struct parallel_scan_stats {
+    std::size_t items{ 0 };
+    std::vector<couchbase::error> errors{};
+};
+
+// Scans each range on its own producer thread, funnelling the items through a bounded queue to
+// `consumers` threads that call `handler`. When consumers fall behind, the queue fills up and the
+// producers stop pulling further items from the SDK until there is room again. At least one
+// consumer is started, as without one the producers would wait for room forever.
+auto
+parallel_scan(
+  const couchbase::collection& collection,
+  const std::vector<couchbase::range_scan>& ranges,
+  const couchbase::scan_options& options,
+  std::size_t producers,
+  std::size_t consumers,
+  std::size_t queue_capacity,
+  const std::function<void(const couchbase::scan_result_item&)>& handler
+) -> parallel_scan_stats
+{
+    bounded_queue<couchbase::scan_result_item> queue(queue_capacity);
+    std::atomic<std::size_t> next_range{ 0 };
+    std::atomic<std::size_t> active_producers{ producers };
+    std::atomic<std::size_t> items{ 0 };
+    std::mutex errors_mutex;
+    std::vector<couchbase::error> errors;
+
+    auto record_error = [&](couchbase::error err) {
+        std::scoped_lock lock(errors_mutex);
+        errors.push_back(std::move(err));
+    };
+
+    auto produce = [&] {
+        for (auto index = next_range++; index < ranges.size(); index = next_range++) {
+            auto [err, result] = collection.scan(ranges[index], options).get();
+            if (err) {
+                record_error(std::move(err));
+                continue;
+            }
+            for (auto [iter_err, item] : result) {
+                if (iter_err) {
+                    record_error(std::move(iter_err));
+                    break;
+                }
+                queue.push(item); // waits while the queue is full, until consumers catch up
+            }
+        }
+        if (--active_producers == 0) {
+            queue.close();
+        }
+    };
+
+    auto consume = [&] {
+        // Waits while the queue is empty, and stops once the producers are done and it is drained
+        while (auto item = queue.pop()) {
+            handler(*item);
+            ++items;
+        }
+    };
+
+    consumers = std::max<std::size_t>(consumers, 1);
+    std::vector<std::thread> threads;
+    if (producers == 0) {
+        queue.close();
+    }
+    for (std::size_t i = 0; i < producers; ++i) {
+        threads.emplace_back(produce);
+    }
+    for (std::size_t i = 0; i < consumers; ++i) {
+        threads.emplace_back(consume);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return { items.load(), std::move(errors) };
+}
+// #end::parallel-scan[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    {
+        // #tag::parallel-scan-usage[]
+        auto ranges = split_key_space("airline_", 16);
+        auto scan_options = couchbase::scan_options().batch_item_limit(500);
+
+        std::atomic<std::size_t> bytes{ 0 };
+        auto start = std::chrono::steady_clock::now();
+        auto stats = parallel_scan(
+          collection,
+          ranges,
+          scan_options,
+          /* producers */ 4,
+          /* consumers */ 2,
+          /* queue_capacity */ 4096,
+          [&bytes](const couchbase::scan_result_item& item) {
+              // Export the document...
+              bytes += item.content_as<std::string, couchbase::codec::raw_json_transcoder>().size();
+          }
+        );
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start
+        );
+
+        fmt::println("Scanned {} documents ({} bytes) in {}", stats.items, bytes.load(), elapsed);
+        for (const auto& err : stats.errors) {
+            fmt::println("Error during scan: {}", err);
+        }
+        // #end::parallel-scan-usage[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,267 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json/to_string.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+
+// #tag::cache[]
+struct prepared_statement_stats {
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+    std::size_t re_prepares{ 0 };
+    std::size_t evictions{ 0 };
+};
+
+// Prepares each statement once with PREPARE, and runs it with EXECUTE from then on, keeping the
+// most recently used `capacity` statements. If the query service reports that a plan is no
+// longer valid -- because an index it used was dropped, say -- the statement is prepared again
+// and retried. Since the indexes have changed, every other cached statement is prepared again
+// too, on its next use. A capacity of zero turns the cache off: every statement is run ad hoc.
+class prepared_statement_cache
+{
+  public:
+    prepared_statement_cache(couchbase::cluster cluster, std::size_t capacity)
+      : cluster_{ std::move(cluster) }
+      , capacity_{ capacity }
+    {
+    }
+
+    auto query(const std::string& statement, couchbase::query_options options = {})
+      -> std::pair<couchbase::error, couchbase::query_result>
+    {
+        if (capacity_ == 0) {
+            {
+                std::scoped_lock lock(mutex_);
+                ++stats_.misses;
+            }
+            options.adhoc(true);
+            return cluster_.query(statement, options).get();
+        }
+        auto [prepare_err, name] = lookup(statement);
+        if (prepare_err) {
+            return { prepare_err, {} };
+        }
+        // EXECUTE is itself run as an ad hoc statement, otherwise the SDK would prepare it again
+        options.adhoc(true);
+        auto [err, result] = cluster_.query(fmt::format("EXECUTE `{}`", name), options).get();
+        if (err.ec() == couchbase::errc::query::prepared_statement_failure) {
+            auto generation = invalidate();
+            if (auto prepare_again_err = prepare(statement, /* re_prepare */ true, generation);
+                prepare_again_err) {
+                return { prepare_again_err, {} };
+            }
+            return cluster_.query(fmt::format("EXECUTE `{}`", name), options).get();
+        }
+        return { err, result };
+    }
+
+    // Prepares every cached statement again now, rather than on its next use. Call this after
+    // changing indexes, so that no query has to fail on a stale plan first.
+    auto refresh() -> couchbase::error
+    {
+        auto generation = invalidate();
+        std::list<std::string> statements;
+        {
+            std::scoped_lock lock(mutex_);
+            statements = lru_;
+        }
+        for (const auto& statement : statements) {
+            if (auto err = prepare(statement, /* re_prepare */ true, generation); err) {
+                return err;
+            }
+        }
+        return {};
+    }
+
+    auto stats() const -> prepared_statement_stats
+    {
+        std::scoped_lock lock(mutex_);
+        return stats_;
+    }
+
+  private:
+    // Prepared statements are shared by every node of the query service, so the name is derived
+    // from the statement text: clients running the same statement share the same plan. The hash
+    // is 64-bit FNV-1a, which unlike std::hash gives the same name in every process and build.
+    static auto name_for(const std::string& statement) -> std::string
+    {
+        std::uint64_t hash{ 0xcbf29ce484222325ULL };
+        for (unsigned char c : statement) {
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        }
+        return fmt::format("cache_{:016x}", hash);
+    }
+
+    // Marks every cached plan as possibly stale, so that each statement is prepared again before
+    // it is next executed. Returns the new generation.
+    auto invalidate() -> std::uint64_t
+    {
+        std::scoped_lock lock(mutex_);
+        return ++generation_;
+    }
+
+    auto lookup(const std::string& statement) -> std::pair<couchbase::error, std::string>
+    {
+        std::uint64_t generation{};
+        bool re_prepare{ false };
+        {
+            std::scoped_lock lock(mutex_);
+            generation = generation_;
+            if (auto found = entries_.find(statement); found != entries_.end()) {
+                lru_.splice(lru_.begin(), lru_, found->second.position);
+                if (found->second.generation == generation) {
+                    ++stats_.hits;
+                    return { {}, found->second.name };
+                }
+                re_prepare = true;
+            } else {
+                ++stats_.misses;
+            }
+        }
+        if (auto err = prepare(statement, re_prepare, generation); err) {
+            return { err, {} };
+        }
+        return { {}, name_for(statement) };
+    }
+
+    // Prepares `statement`, and records it in the cache as prepared as of `generation`.
+    auto prepare(const std::string& statement, bool re_prepare, std::uint64_t generation)
+      -> couchbase::error
+    {
+        auto name = name_for(statement);
+        // FORCE replaces a plan already stored under this name, rather than reusing it
+        auto force = re_prepare ? "FORCE " : "";
+        auto [err, result] =
+          cluster_.query(fmt::format("PREPARE {}`{}` FROM {}", force, name, statement), {}).get();
+        if (err) {
+            return err;
+        }
+        std::scoped_lock lock(mutex_);
+        if (re_prepare) {
+            ++stats_.re_prepares;
+        }
+        if (auto found = entries_.find(statement); found != entries_.end()) {
+            found->second.generation = generation;
+            return {};
+        }
+        lru_.push_front(statement);
+        entries_.emplace(statement, entry{ std::move(name), lru_.begin(), generation });
+        if (lru_.size() > capacity_) {
+            entries_.erase(lru_.back());
+            lru_.pop_back();
+            ++stats_.evictions;
+        }
+        return {};
+    }
+
+    struct entry {
+        std::string name;
+        std::list<std::string>::iterator position;
+        std::uint64_t generation; // the value of generation_ when the statement was prepared
+    };
+
+    couchbase::cluster cluster_;
+    std::size_t capacity_;
+    mutable std::mutex mutex_{};
+    std::list<std::string> lru_{}; // most recently used first
+    std::unordered_map<std::string, entry> entries_{};
+    std::uint64_t generation_{ 0 };
+    prepared_statement_stats stats_{};
+};
+// #end::cache[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+
+    std::string statement{
+        "SELECT COUNT(*) FROM `travel-sample`.inventory.airport WHERE country=$1"
+    };
+
+    {
+        // #tag::usage[]
+        prepared_statement_cache cache(cluster, /* capacity */ 128);
+
+        for (const auto* country : { "United States", "France", "United Kingdom", "France" }) {
+            auto [err, result] =
+              cache.query(statement, couchbase::query_options().positional_parameters(country));
+            if (err) {
+                fmt::println("Error: {}", err);
+                continue;
+            }
+            fmt::println("{}: {}", country, tao::json::to_string(result.rows_as_json().at(0)));
+        }
+
+        // After creating or dropping an index, prepare the cached statements again up front
+        if (auto err = cache.refresh(); err) {
+            fmt::println("Error: {}", err);
+        }
+
+        auto stats = cache.stats();
+        fmt::println(
+          "hits: {}, misses: {}, re-prepares: {}, evictions: {}",
+          stats.hits,
+          stats.misses,
+          stats.re_prepares,
+          stats.evictions
+        );
+        // #end::usage[]
+    }
+
+    {
+        // #tag::benchmark[]
+        // Compare the mean latency of running the same short statement ad hoc, which plans it
+        // every time, with running it through the prepared statement cache.
+        constexpr int iterations{ 1'000 };
+        prepared_statement_cache cache(cluster, /* capacity */ 16);
+
+        auto mean_latency = [&](auto&& run) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                if (auto err = run(); err) {
+                    fmt::println("Error: {}", err);
+                    break;
+                }
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            return std::chrono::duration_cast<std::chrono::microseconds>(elapsed) / iterations;
+        };
+
+        auto adhoc = mean_latency([&] {
+            auto options = couchbase::query_options().adhoc(true).positional_parameters("France");
+            return cluster.query(statement, options).get().first;
+        });
+        auto prepared = mean_latency([&] {
+            auto options = couchbase::query_options().positional_parameters("France");
+            return cache.query(statement, options).first;
+        });
+        fmt::println("ad hoc: {} per query, prepared: {} per query", adhoc, prepared);
+        // #end::benchmark[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,335 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/codec/encoded_value.hxx>
+#include <couchbase/codec/raw_json_transcoder.hxx>
+#include <couchbase/codec/transcoder_traits.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ "inventory" };
+static constexpr auto collection_name{ "hotel" };
+
+// #tag::view-transcoder[]
+// Decodes to a view of the JSON text held by the result itself, so nothing is copied. The view is
+// only valid for as long as the result it was taken from.
+struct raw_json_view_transcoder {
+    using document_type = std::string_view;
+
+    static auto decode(const couchbase::codec::encoded_value& encoded) -> std::string_view
+    {
+        return { reinterpret_cast<const char*>(encoded.data.data()), encoded.data.size() };
+    }
+};
+
+template<>
+struct couchbase::codec::is_transcoder<raw_json_view_transcoder> : public std::true_type {
+};
+// #end::view-transcoder[]
+
+// #tag::lazy-json[]
+// A read-only view over a JSON document which locates fields on demand. Looking up a path only
+// scans the text up to that field, skipping over everything else without building a DOM; only the
+// value that was asked for is decoded.
+class lazy_json
+{
+  public:
+    explicit lazy_json(std::string_view document)
+      : document_{ document }
+    {
+    }
+
+    // Returns the raw JSON text of the value at `path`, for example "address.city" or
+    // "reviews[0].ratings.Overall", or std::nullopt if there is no such value.
+    auto raw(std::string_view path) const -> std::optional<std::string_view>
+    {
+        auto position = skip_whitespace(0);
+        while (!path.empty() && position != npos) {
+            if (path.front() == '[') {
+                auto close = path.find(']');
+                if (close == std::string_view::npos) {
+                    return std::nullopt;
+                }
+                position = find_element(position, to_index(path.substr(1, close - 1)));
+                path.remove_prefix(close + 1);
+            } else {
+                auto end = path.find_first_of(".[");
+                position = find_member(position, path.substr(0, end));
+                path.remove_prefix(end == std::string_view::npos ? path.size() : end);
+            }
+            if (!path.empty() && path.front() == '.') {
+                path.remove_prefix(1);
+            }
+        }
+        if (position == npos) {
+            return std::nullopt;
+        }
+        auto end = skip_value(position);
+        if (end == npos) {
+            return std::nullopt;
+        }
+        return document_.substr(position, end - position);
+    }
+
+    // Decodes just the value at `path`.
+    template<typename T>
+    auto get(std::string_view path) const -> std::optional<T>
+    {
+        auto text = raw(path);
+        if (!text) {
+            return std::nullopt;
+        }
+        return tao::json::from_string(*text).template as<T>();
+    }
+
+  private:
+    static constexpr auto npos{ std::string_view::npos };
+
+    static auto is_whitespace(char c) -> bool
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static auto to_index(std::string_view digits) -> std::size_t
+    {
+        std::size_t index{ 0 };
+        for (char c : digits) {
+            if (c < '0' || c > '9') {
+                return npos;
+            }
+            index = index * 10 + static_cast<std::size_t>(c - '0');
+        }
+        return index;
+    }
+
+    auto skip_whitespace(std::size_t i) const -> std::size_t
+    {
+        while (i < document_.size() && is_whitespace(document_[i])) {
+            ++i;
+        }
+        return i < document_.size() ? i : npos;
+    }
+
+    // `i` points at an opening quote; returns the position just past the closing one.
+    auto skip_string(std::size_t i) const -> std::size_t
+    {
+        for (++i; i < document_.size(); ++i) {
+            if (document_[i] == '\\') {
+                ++i;
+            } else if (document_[i] == '"') {
+                return i + 1;
+            }
+        }
+        return npos;
+    }
+
+    // Returns the position just past the value starting at `i`.
+    auto skip_value(std::size_t i) const -> std::size_t
+    {
+        if (i >= document_.size()) {
+            return npos;
+        }
+        if (document_[i] == '"') {
+            return skip_string(i);
+        }
+        if (document_[i] == '{' || document_[i] == '[') {
+            std::size_t depth{ 0 };
+            while (i < document_.size()) {
+                auto c = document_[i];
+                if (c == '"') {
+                    if (i = skip_string(i); i == npos) {
+                        return npos;
+                    }
+                    continue;
+                }
+                if (c == '{' || c == '[') {
+                    ++depth;
+                } else if ((c == '}' || c == ']') && --depth == 0) {
+                    return i + 1;
+                }
+                ++i;
+            }
+            return npos;
+        }
+        // A number, true, false or null
+        while (i < document_.size() && document_[i] != ',' && document_[i] != '}' &&
+               document_[i] != ']' && !is_whitespace(document_[i])) {
+            ++i;
+        }
+        return i;
+    }
+
+    // Moves past the value at `i` and the comma following it, if any.
+    auto next_item(std::size_t i) const -> std::size_t
+    {
+        if (i = skip_value(i); i == npos || (i = skip_whitespace(i)) == npos) {
+            return npos;
+        }
+        return document_[i] == ',' ? skip_whitespace(i + 1) : i;
+    }
+
+    // `i` points at an object; returns the position of the value of member `name`.
+    auto find_member(std::size_t i, std::string_view name) const -> std::size_t
+    {
+        if (i == npos || document_[i] != '{') {
+            return npos;
+        }
+        i = skip_whitespace(i + 1);
+        while (i != npos && document_[i] == '"') {
+            auto key_end = skip_string(i);
+            if (key_end == npos) {
+                return npos;
+            }
+            auto key = document_.substr(i, key_end - i);
+            i = skip_whitespace(key_end);
+            if (i == npos || document_[i] != ':') {
+                return npos;
+            }
+            i = skip_whitespace(i + 1);
+            if (key_matches(key, name)) {
+                return i;
+            }
+            i = next_item(i);
+        }
+        return npos;
+    }
+
+    // `quoted` is a member name as written, quotes included. Most names have no escapes and are
+    // compared as they are; the rest are decoded first, so that "caf\u00e9" matches "café".
+    static auto key_matches(std::string_view quoted, std::string_view name) -> bool
+    {
+        auto key = quoted.substr(1, quoted.size() - 2);
+        if (key.find('\\') == std::string_view::npos) {
+            return key == name;
+        }
+        try {
+            return tao::json::from_string(quoted).get_string() == name;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    // `i` points at an array; returns the position of element `index`.
+    auto find_element(std::size_t i, std::size_t index) const -> std::size_t
+    {
+        if (i == npos || index == npos || document_[i] != '[') {
+            return npos;
+        }
+        i = skip_whitespace(i + 1);
+        for (; i != npos && document_[i] != ']'; --index) {
+            if (index == 0) {
+                return i;
+            }
+            i = next_item(i);
+        }
+        return npos;
+    }
+
+    std::string_view document_;
+};
+// #end::lazy-json[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    auto [err, result] = collection.get("hotel_10025").get();
+    if (err) {
+        fmt::println("Error getting document: {}", err);
+        return 1;
+    }
+
+    {
+        // #tag::raw-bytes[]
+        // The raw JSON transcoder hands back the document exactly as stored, without parsing it
+        auto bytes = result.content_as<std::string, couchbase::codec::raw_json_transcoder>();
+
+        // ...so it can be forwarded as-is, for example to another collection or over the network
+        auto archive = cluster.bucket(bucket_name).scope(scope_name).collection("hotel");
+        auto [upsert_err, upsert_res] =
+          archive.upsert<couchbase::codec::raw_json_transcoder>("hotel_10025-copy", bytes).get();
+        if (upsert_err) {
+            fmt::println("Error: {}", upsert_err);
+        }
+        // #end::raw-bytes[]
+        archive.remove("hotel_10025-copy").get();
+    }
+
+    {
+        // #tag::lazy-get[]
+        // A view of the text in `result`, which must outlive it
+        auto text = result.content_as<raw_json_view_transcoder>();
+        lazy_json document{ text };
+
+        // Only the requested values are parsed
+        auto city = document.get<std::string>("city");
+        auto overall = document.get<std::int64_t>("reviews[0].ratings.Overall");
+        fmt::println(
+          "City: {}, first review rating: {}", city.value_or("unknown"), overall.value_or(0)
+        );
+        // #end::lazy-get[]
+    }
+
+    {
+        // #tag::benchmark[]
+        // Compare decoding the whole document into a DOM with reading the one field we need, from
+        // a copy of the text and from a view of it. Every path starts from the same get_result
+        // and decodes the city into a std::string, so this measures only client-side decoding.
+        constexpr int iterations{ 100'000 };
+        std::size_t total{ 0 };
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            auto content = result.content_as<tao::json::value>();
+            total += content.at("city").get_string().size();
+        }
+        auto dom = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            auto bytes = result.content_as<std::string, couchbase::codec::raw_json_transcoder>();
+            total += lazy_json{ bytes }.get<std::string>("city").value_or("").size();
+        }
+        auto lazy = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            auto text = result.content_as<raw_json_view_transcoder>();
+            total += lazy_json{ text }.get<std::string>("city").value_or("").size();
+        }
+        auto view = std::chrono::steady_clock::now() - start;
+
+        using ns = std::chrono::nanoseconds;
+        fmt::println("DOM:  {} per document", std::chrono::duration_cast<ns>(dom) / iterations);
+        fmt::println("Lazy: {} per document", std::chrono::duration_cast<ns>(lazy) / iterations);
+        fmt::println("View: {} per document", std::chrono::duration_cast<ns>(view) / iterations);
+        fmt::println("(checksum {})", total);
+        // #end::benchmark[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
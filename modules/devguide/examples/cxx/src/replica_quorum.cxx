@@ -0,0 +1,291 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/cas.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "default" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::fan-out[]
+template<typename Value>
+struct replica_read {
+    Value value{};
+    couchbase::cas cas{};
+    bool replica{ false };
+
+    auto is_replica() const -> bool
+    {
+        return replica;
+    }
+};
+
+// Reads every copy of a document in parallel and hands each one to the caller as soon as it
+// arrives, instead of waiting for the slowest replica as lookup_in_all_replicas() does.
+//
+// The public API has no way to address an individual replica, so three requests are sent at once:
+// lookup_in() for the active copy, lookup_in_any_replica() for whichever copy answers first, and
+// lookup_in_all_replicas() for the rest. A copy returned by both replica requests is passed to
+// the caller only once, whichever of them completes first.
+class replica_fan_out
+{
+  public:
+    explicit replica_fan_out(couchbase::collection collection)
+      : collection_{ std::move(collection) }
+    {
+    }
+
+    // Calls `on_read` with each copy as it arrives, until it returns false or every copy has been
+    // read. `decode` turns a lookup_in_result or lookup_in_replica_result into a Value; a copy it
+    // throws for is skipped. Returns an error only if no copy could be read, or none decoded.
+    template<typename Decode, typename OnRead>
+    auto lookup_in(
+      const std::string& id,
+      const couchbase::lookup_in_specs& specs,
+      Decode decode,
+      OnRead on_read
+    ) -> couchbase::error
+    {
+        using value_type = decltype(decode(std::declval<couchbase::lookup_in_result>()));
+        auto state = std::make_shared<arrivals<value_type>>();
+
+        collection_.lookup_in(id, specs, {}, [state, decode](auto err, auto result) {
+            state->push(source::active, err, [&] {
+                return std::vector{ defer(decode, result, /* replica */ false) };
+            });
+        });
+        collection_.lookup_in_any_replica(id, specs, {}, [state, decode](auto err, auto result) {
+            state->push(source::any, err, [&] {
+                return std::vector{ defer(decode, result, result.is_replica()) };
+            });
+        });
+        collection_.lookup_in_all_replicas(id, specs, {}, [state, decode](auto err, auto results) {
+            state->push(source::all, err, [&] {
+                std::vector<pending_read<value_type>> reads;
+                for (const auto& result : results) {
+                    reads.push_back(defer(decode, result, result.is_replica()));
+                }
+                return reads;
+            });
+        });
+
+        // The replica returned by lookup_in_any_replica() is also one of those returned by
+        // lookup_in_all_replicas(), and either may arrive first. Whichever arrives second drops
+        // one copy with the same CAS as a copy the other has already delivered, so that each
+        // replica is counted once in either order:
+        //
+        //   any first: any delivers R1 (CAS c); all delivers R1, R2 and drops one copy with CAS c
+        //   all first: all delivers R1, R2; any delivers R1 (CAS c) and drops it, as all sent c
+        bool active_seen{ false };
+        std::vector<couchbase::cas> delivered_by_any{};
+        std::vector<couchbase::cas> delivered_by_all{};
+        std::size_t delivered{ 0 };
+        couchbase::error decode_error{};
+        while (auto arrival = state->next()) {
+            for (auto& read : arrival->reads) {
+                if (!read.replica) {
+                    if (std::exchange(active_seen, true)) {
+                        continue;
+                    }
+                } else if (arrival->from != source::active) {
+                    auto from_all = arrival->from == source::all;
+                    auto& other = from_all ? delivered_by_any : delivered_by_all;
+                    auto& own = from_all ? delivered_by_all : delivered_by_any;
+                    if (auto seen = std::find(other.begin(), other.end(), read.cas);
+                        seen != other.end()) {
+                        other.erase(seen);
+                        continue;
+                    }
+                    own.push_back(read.cas);
+                }
+                replica_read<value_type> copy{ {}, read.cas, read.replica };
+                try {
+                    copy.value = read.decode();
+                } catch (const std::exception& e) {
+                    decode_error = { couchbase::errc::common::decoding_failure, e.what() };
+                    continue;
+                }
+                ++delivered;
+                if (!on_read(copy)) {
+                    return {};
+                }
+            }
+        }
+        if (delivered == 0) {
+            return decode_error ? decode_error : state->first_error();
+        }
+        return {};
+    }
+
+    // Returns the first copy for which `quorum` copies (counting itself) share the same CAS, as
+    // soon as they have arrived, or std::nullopt if the copies do not agree.
+    template<typename Decode>
+    auto lookup_in_quorum(
+      const std::string& id,
+      const couchbase::lookup_in_specs& specs,
+      std::size_t quorum,
+      Decode decode
+    )
+    {
+        using value_type = decltype(decode(std::declval<couchbase::lookup_in_result>()));
+        std::map<std::uint64_t, std::size_t> votes;
+        std::optional<replica_read<value_type>> agreed{};
+        auto err = lookup_in(id, specs, std::move(decode), [&](const auto& read) {
+            if (++votes[read.cas.value()] < quorum) {
+                return true;
+            }
+            agreed = read;
+            return false;
+        });
+        return std::make_pair(err, agreed);
+    }
+
+  private:
+    enum class source { active, any, all };
+
+    // A copy as it arrived, decoded only once it is known not to be a duplicate.
+    template<typename Value>
+    struct pending_read {
+        std::function<Value()> decode;
+        couchbase::cas cas;
+        bool replica;
+    };
+
+    template<typename Decode, typename Result>
+    static auto defer(Decode decode, Result result, bool replica)
+    {
+        auto cas = result.cas();
+        return pending_read<decltype(decode(result))>{
+            [decode, result = std::move(result)] { return decode(result); }, cas, replica
+        };
+    }
+
+    template<typename Value>
+    struct arrival {
+        source from;
+        std::vector<pending_read<Value>> reads;
+    };
+
+    // Results are queued by the SDK's callbacks, and decoded and consumed on the calling thread, so
+    // that neither `decode` nor the caller's handler runs on the SDK's I/O threads.
+    template<typename Value>
+    class arrivals
+    {
+      public:
+        template<typename Reads>
+        void push(source from, const couchbase::error& err, Reads&& reads)
+        {
+            std::scoped_lock lock(mutex_);
+            if (err) {
+                if (!first_error_) {
+                    first_error_ = err;
+                }
+            } else {
+                queue_.push_back({ from, reads() });
+            }
+            ++completed_;
+            changed_.notify_all();
+        }
+
+        // The next result to arrive, or std::nullopt once all three requests have completed.
+        auto next() -> std::optional<arrival<Value>>
+        {
+            std::unique_lock lock(mutex_);
+            changed_.wait(lock, [this] { return !queue_.empty() || completed_ == requests; });
+            if (queue_.empty()) {
+                return std::nullopt;
+            }
+            auto front = std::move(queue_.front());
+            queue_.pop_front();
+            return front;
+        }
+
+        auto first_error() -> couchbase::error
+        {
+            std::scoped_lock lock(mutex_);
+            return first_error_.value_or(couchbase::error{});
+        }
+
+      private:
+        static constexpr std::size_t requests{ 3 };
+
+        std::mutex mutex_{};
+        std::condition_variable changed_{};
+        std::deque<arrival<Value>> queue_{};
+        std::optional<couchbase::error> first_error_{};
+        std::size_t completed_{ 0 };
+    };
+
+    couchbase::collection collection_;
+};
+// #end::fan-out[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    replica_fan_out replicas(collection);
+    auto country = [](const auto& result) { return result.template content_as<std::string>(0); };
+    couchbase::lookup_in_specs specs{
+        couchbase::lookup_in_specs::get("addresses.delivery.country"),
+    };
+
+    {
+        // #tag::stream[]
+        auto err = replicas.lookup_in("customer123", specs, country, [](const auto& read) {
+            fmt::println(
+              "Country: {} Is replica: {} CAS: {}", read.value, read.is_replica(), read.cas
+            );
+            return true; // keep reading
+        });
+        if (err) {
+            fmt::println("Error: {}", err);
+        }
+        // #end::stream[]
+    }
+
+    {
+        // #tag::quorum[]
+        auto [err, agreed] = replicas.lookup_in_quorum("customer123", specs, 2, country);
+        if (err) {
+            fmt::println("Error: {}", err);
+        } else if (!agreed) {
+            fmt::println("Copies of customer123 do not agree yet");
+        } else {
+            fmt::println("Country: {} (agreed on CAS {})", agreed->value, agreed->cas);
+        }
+        // #end::quorum[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
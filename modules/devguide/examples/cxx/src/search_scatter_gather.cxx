@@ -0,0 +1,230 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+#include <couchbase/match_query.hxx>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ "inventory" };
+
+// #tag::scatter[]
+// An index to search: a scoped index if `scope` is set, otherwise a global one.
+struct search_target {
+    std::string index;
+    std::optional<couchbase::scope> scope{};
+};
+
+using search_results = std::vector<std::pair<couchbase::error, couchbase::search_result>>;
+
+// Runs `request` against every target at once. The future is ready once all of them have
+// answered, with their results in the same order as `targets`.
+inline auto
+scatter_search(
+  const couchbase::cluster& cluster,
+  const std::vector<search_target>& targets,
+  const couchbase::search_request& request,
+  const couchbase::search_options& options = {}
+) -> std::future<search_results>
+{
+    struct state {
+        search_results results;
+        std::atomic<std::size_t> remaining;
+        std::promise<search_results> barrier{};
+    };
+    auto shared = std::make_shared<state>();
+    shared->results.resize(targets.size());
+    shared->remaining = targets.size();
+    auto future = shared->barrier.get_future();
+    if (targets.empty()) {
+        shared->barrier.set_value({});
+        return future;
+    }
+
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        auto handler = [shared, i](auto err, auto result) {
+            shared->results[i] = { err, std::move(result) };
+            if (--shared->remaining == 0) {
+                shared->barrier.set_value(std::move(shared->results));
+            }
+        };
+        if (const auto& scope = targets[i].scope; scope) {
+            scope->search(targets[i].index, request, options, std::move(handler));
+        } else {
+            cluster.search(targets[i].index, request, options, std::move(handler));
+        }
+    }
+    return future;
+}
+// #end::scatter[]
+
+// #tag::top-k[]
+// The `k` best-scoring rows across all of the results, highest score first. Only `k` rows are
+// held while merging, in a min-heap whose top is the weakest row kept so far.
+//
+// Scores from different indexes are only comparable when the indexes share a definition -- one
+// index per tenant, say -- since each index scores against the statistics of its own documents.
+inline auto
+top_k(const search_results& results, std::size_t k) -> std::vector<couchbase::search_row>
+{
+    auto weaker = [](const couchbase::search_row* a, const couchbase::search_row* b) {
+        return a->score() > b->score();
+    };
+    std::priority_queue<
+      const couchbase::search_row*,
+      std::vector<const couchbase::search_row*>,
+      decltype(weaker)>
+      heap(weaker);
+
+    for (const auto& [err, result] : results) {
+        if (err) {
+            continue;
+        }
+        for (const auto& row : result.rows()) {
+            if (heap.size() < k) {
+                heap.push(&row);
+            } else if (k > 0 && row.score() > heap.top()->score()) {
+                heap.pop();
+                heap.push(&row);
+            }
+        }
+    }
+
+    std::vector<couchbase::search_row> best;
+    best.reserve(heap.size());
+    for (; !heap.empty(); heap.pop()) {
+        best.push_back(*heap.top());
+    }
+    std::reverse(best.begin(), best.end());
+    return best;
+}
+// #end::top-k[]
+
+// #tag::fusion[]
+struct fused_hit {
+    std::string id;
+    double score;
+};
+
+// Combines rankings whose scores cannot be compared -- an FTS ranking and a vector ranking, for
+// example -- with reciprocal rank fusion: each document scores 1 / (rank_constant + rank) in every
+// ranking it appears in, and the `k` documents with the highest sum are returned, best first.
+inline auto
+reciprocal_rank_fusion(
+  const search_results& rankings,
+  std::size_t k,
+  double rank_constant = 60.0
+) -> std::vector<fused_hit>
+{
+    std::map<std::string, double> scores;
+    for (const auto& [err, result] : rankings) {
+        if (err) {
+            continue;
+        }
+        // Rows are returned best first, and ranks count from one
+        for (std::size_t rank = 0; rank < result.rows().size(); ++rank) {
+            const auto& id = result.rows()[rank].id();
+            scores[id] += 1.0 / (rank_constant + static_cast<double>(rank + 1));
+        }
+    }
+
+    std::vector<fused_hit> fused;
+    fused.reserve(scores.size());
+    for (auto& [id, score] : scores) {
+        fused.push_back({ id, score });
+    }
+    auto count = std::min(k, fused.size());
+    std::partial_sort(
+      fused.begin(), fused.begin() + count, fused.end(), [](const auto& a, const auto& b) {
+          return a.score > b.score;
+      }
+    );
+    fused.resize(count);
+    return fused;
+}
+// #end::fusion[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto scope = cluster.bucket(bucket_name).scope(scope_name);
+
+    {
+        // #tag::tenants[]
+        // One index per tenant, all with the same definition, searched at the same time
+        std::vector<search_target> tenants;
+        for (const auto& tenant : { "tenant-a", "tenant-b", "tenant-c", "tenant-d" }) {
+            tenants.push_back({ fmt::format("hotels-{}", tenant), scope });
+        }
+
+        // Each index needs to return its own best 10 for the merged best 10 to be right
+        auto request = couchbase::search_request(couchbase::match_query("swanky"));
+        auto results =
+          scatter_search(cluster, tenants, request, couchbase::search_options().limit(10)).get();
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            if (const auto& [err, result] = results[i]; err) {
+                fmt::println("Search of {} failed: {}", tenants[i].index, err);
+            }
+        }
+        for (const auto& row : top_k(results, 10)) {
+            fmt::println("{:.4f} {} ({})", row.score(), row.id(), row.index());
+        }
+        // #end::tenants[]
+    }
+
+    {
+        std::vector<double> embedding(1536, 0.0);
+
+        // #tag::hybrid[]
+        // The same question as keywords and as an embedding, against an FTS and a vector index
+        auto keywords = scatter_search(
+          cluster,
+          { { "hotels-description", scope } },
+          couchbase::search_request(couchbase::match_query("quiet hotel near the beach")),
+          couchbase::search_options().limit(50)
+        );
+        auto neighbours = scatter_search(
+          cluster,
+          { { "hotels-description-vector", scope } },
+          couchbase::search_request(couchbase::vector_search(
+            couchbase::vector_query("description_vector", embedding).num_candidates(50)
+          )),
+          couchbase::search_options().limit(50)
+        );
+
+        search_results rankings = keywords.get();
+        for (auto& ranking : neighbours.get()) {
+            rankings.push_back(std::move(ranking));
+        }
+        for (const auto& hit : reciprocal_rank_fusion(rankings, 10)) {
+            fmt::println("{:.4f} {}", hit.score, hit.id);
+        }
+        // #end::hybrid[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
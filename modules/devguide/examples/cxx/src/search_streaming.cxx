@@ -0,0 +1,149 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/codec/tao_json_serializer.hxx>
+#include <couchbase/fmt/error.hxx>
+#include <couchbase/match_query.hxx>
+
+#include <fmt/format.h>
+#include <tao/json/value.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ "inventory" };
+
+// #tag::stream[]
+// Reads the rows of a search a page at a time, however many there are. Rows are sorted by
+// document ID, and each page asks for the rows after the last ID of the page before it
+// ("search_after"), so that the cost of a page does not grow with its depth as it does with
+// skip(). The next page is fetched while the current one is being read, so at most two pages are
+// held at once.
+//
+// Only what the options ask for is decoded with each row. The stream leaves locations and
+// highlighting off unless they are set in `options`, and a row's fields stay as raw JSON until
+// fields_as() is called, so rows which are only counted or skipped cost little.
+class search_row_stream
+{
+  public:
+    search_row_stream(
+      couchbase::scope scope,
+      std::string index_name,
+      couchbase::search_request request,
+      couchbase::search_options options = {},
+      std::uint32_t page_size = 1'000
+    )
+      : scope_{ std::move(scope) }
+      , index_name_{ std::move(index_name) }
+      , request_{ std::move(request) }
+      , options_{ std::move(options) }
+      , page_size_{ page_size }
+    {
+        options_.sort({ "_id" }).limit(page_size_);
+        fetch({});
+    }
+
+    // The next row, or std::nullopt once every row has been read. Stops at the first error.
+    auto next() -> std::pair<couchbase::error, std::optional<couchbase::search_row>>
+    {
+        while (position_ == page_.size()) {
+            if (!next_page_) {
+                return { {}, std::nullopt };
+            }
+            auto [err, result] = next_page_->get();
+            next_page_.reset();
+            if (err) {
+                return { err, std::nullopt };
+            }
+            page_ = result.rows();
+            position_ = 0;
+            if (page_.size() == page_size_) {
+                fetch(page_.back().id());
+            }
+        }
+        ++rows_read_;
+        return { {}, std::move(page_[position_++]) };
+    }
+
+    auto rows_read() const -> std::uint64_t
+    {
+        return rows_read_;
+    }
+
+  private:
+    void fetch(const std::string& after)
+    {
+        auto options = options_;
+        if (!after.empty()) {
+            options.raw("search_after", std::vector<std::string>{ after });
+        }
+        next_page_ = scope_.search(index_name_, request_, options);
+    }
+
+    couchbase::scope scope_;
+    std::string index_name_;
+    couchbase::search_request request_;
+    couchbase::search_options options_;
+    std::uint32_t page_size_;
+    std::optional<std::future<std::pair<couchbase::error, couchbase::search_result>>> next_page_{};
+    std::vector<couchbase::search_row> page_{};
+    std::size_t position_{ 0 };
+    std::uint64_t rows_read_{ 0 };
+};
+// #end::stream[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto scope = cluster.bucket(bucket_name).scope(scope_name);
+
+    {
+        // #tag::export[]
+        // Exports the name and city of every matching hotel, without holding all of the hits
+        search_row_stream rows(
+          scope,
+          "travel-sample-index-hotel-description",
+          couchbase::search_request(couchbase::match_query("hotel")),
+          couchbase::search_options().fields({ "name", "city" })
+        );
+        while (true) {
+            auto [err, row] = rows.next();
+            if (err) {
+                fmt::println("Export stopped after {} rows: {}", rows.rows_read(), err);
+                break;
+            }
+            if (!row) {
+                fmt::println("Exported {} rows", rows.rows_read());
+                break;
+            }
+            // The fields are decoded here, one row at a time
+            auto fields = row->fields_as<couchbase::codec::tao_json_serializer>();
+            fmt::println(
+              "{}: {}, {}",
+              row->id(),
+              fields.at("name").get_string(),
+              fields.at("city").get_string()
+            );
+        }
+        // #end::export[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
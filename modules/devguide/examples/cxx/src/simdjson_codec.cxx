@@ -0,0 +1,293 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/codec/json_transcoder.hxx>
+#include <couchbase/codec/serializer_traits.hxx>
+#include <couchbase/codec/tao_json_serializer.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <simdjson.h>
+#include <tao/json.hpp>
+
+#include <chrono>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+
+// #tag::row-type[]
+struct airport {
+    std::string airportname{};
+    std::string city{};
+    std::string country{};
+    std::string faa{};
+    double lat{};
+    double lon{};
+};
+// #end::row-type[]
+
+// The taoJSON binding, used by the default serializer
+template<>
+struct tao::json::traits<airport>
+  : tao::json::binding::object<
+      TAO_JSON_BIND_REQUIRED("airportname", &airport::airportname),
+      TAO_JSON_BIND_REQUIRED("city", &airport::city),
+      TAO_JSON_BIND_REQUIRED("country", &airport::country),
+      TAO_JSON_BIND_OPTIONAL("faa", &airport::faa),
+      TAO_JSON_BIND_REQUIRED("lat", &airport::lat),
+      TAO_JSON_BIND_REQUIRED("lon", &airport::lon)> {
+};
+
+// #tag::serializer[]
+// Describes how a type is read from a simdjson element and written as JSON text. Specialise this
+// for each row or document type that should go through simdjson_serializer.
+template<typename T>
+struct simdjson_binding;
+
+template<typename T, typename = void>
+struct has_simdjson_binding : std::false_type {
+};
+
+template<typename T>
+struct has_simdjson_binding<T, std::void_t<decltype(sizeof(simdjson_binding<T>))>>
+  : std::true_type {
+};
+
+// A serializer which parses with simdjson -- using SIMD instructions where the CPU supports them --
+// and writes JSON text directly, without an intermediate DOM. Types without a simdjson_binding
+// fall back to taoJSON, so tao::json::value can still be used.
+struct simdjson_serializer {
+    using document_type = tao::json::value;
+
+    template<typename Document>
+    static auto serialize(const Document& document) -> couchbase::codec::binary
+    {
+        std::string out;
+        if constexpr (has_simdjson_binding<Document>::value) {
+            simdjson_binding<Document>::encode(document, out);
+        } else {
+            out = tao::json::to_string(tao::json::value(document));
+        }
+        auto bytes = reinterpret_cast<const std::byte*>(out.data());
+        return { bytes, bytes + out.size() };
+    }
+
+    template<typename Document>
+    static auto deserialize(const couchbase::codec::binary& data) -> Document
+    {
+        // Parsers keep their internal buffers between calls, so reuse one per thread
+        thread_local simdjson::dom::parser parser;
+        simdjson::dom::element element;
+        auto err =
+          parser.parse(reinterpret_cast<const char*>(data.data()), data.size()).get(element);
+        if (err) {
+            throw std::system_error(
+              couchbase::errc::common::decoding_failure, simdjson::error_message(err)
+            );
+        }
+        if constexpr (has_simdjson_binding<Document>::value) {
+            return simdjson_binding<Document>::decode(element);
+        } else {
+            return to_tao(element).template as<Document>();
+        }
+    }
+
+  private:
+    static auto to_tao(simdjson::dom::element element) -> tao::json::value
+    {
+        switch (element.type()) {
+            case simdjson::dom::element_type::ARRAY: {
+                tao::json::value array = tao::json::empty_array;
+                for (auto child : element.get_array().value_unsafe()) {
+                    array.emplace_back(to_tao(child));
+                }
+                return array;
+            }
+            case simdjson::dom::element_type::OBJECT: {
+                tao::json::value object = tao::json::empty_object;
+                for (auto [key, child] : element.get_object().value_unsafe()) {
+                    object.emplace(std::string(key), to_tao(child));
+                }
+                return object;
+            }
+            case simdjson::dom::element_type::INT64:
+                return element.get_int64().value_unsafe();
+            case simdjson::dom::element_type::UINT64:
+                return element.get_uint64().value_unsafe();
+            case simdjson::dom::element_type::DOUBLE:
+                return element.get_double().value_unsafe();
+            case simdjson::dom::element_type::STRING:
+                return std::string(element.get_string().value_unsafe());
+            case simdjson::dom::element_type::BOOL:
+                return element.get_bool().value_unsafe();
+            case simdjson::dom::element_type::NULL_VALUE:
+                break;
+        }
+        return tao::json::null;
+    }
+};
+
+template<>
+struct couchbase::codec::is_serializer<simdjson_serializer> : public std::true_type {
+};
+
+// Use as the transcoder for KV operations, e.g. content_as<airport, simdjson_transcoder>()
+using simdjson_transcoder = couchbase::codec::json_transcoder<simdjson_serializer>;
+// #end::serializer[]
+
+// #tag::binding[]
+// Appends `value` to `out` as a JSON string.
+void
+write_json_string(std::string& out, std::string_view value)
+{
+    out.push_back('"');
+    for (char c : value) {
+        switch (c) {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<int>(c));
+                } else {
+                    out.push_back(c);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+template<>
+struct simdjson_binding<airport> {
+    static auto decode(simdjson::dom::element element) -> airport
+    {
+        airport result;
+        std::string_view text;
+        if (!element["airportname"].get(text)) {
+            result.airportname = text;
+        }
+        if (!element["city"].get(text)) {
+            result.city = text;
+        }
+        if (!element["country"].get(text)) {
+            result.country = text;
+        }
+        if (!element["faa"].get(text)) {
+            result.faa = text;
+        }
+        // Coordinates may be stored as integers or doubles; reading a double accepts both
+        double number;
+        if (!element["lat"].get(number)) {
+            result.lat = number;
+        }
+        if (!element["lon"].get(number)) {
+            result.lon = number;
+        }
+        return result;
+    }
+
+    static void encode(const airport& value, std::string& out)
+    {
+        out.append(R"({"airportname":)");
+        write_json_string(out, value.airportname);
+        out.append(R"(,"city":)");
+        write_json_string(out, value.city);
+        out.append(R"(,"country":)");
+        write_json_string(out, value.country);
+        out.append(R"(,"faa":)");
+        write_json_string(out, value.faa);
+        fmt::format_to(std::back_inserter(out), R"(,"lat":{},"lon":{}}})", value.lat, value.lon);
+    }
+};
+// #end::binding[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+
+    {
+        // #tag::rows[]
+        auto [err, result] = cluster
+                               .query(
+                                 "SELECT airportname, city, country, faa, geo.lat AS lat, "
+                                 "geo.lon AS lon FROM `travel-sample`.inventory.airport",
+                                 {}
+                               )
+                               .get();
+        if (err) {
+            fmt::println("Error: {}", err);
+            return 1;
+        }
+        auto airports = result.rows_as<simdjson_serializer, airport>();
+        fmt::println("Got {} airports, first is {}", airports.size(), airports.at(0).airportname);
+        // #end::rows[]
+
+        // #tag::benchmark[]
+        // Decode the same result set repeatedly with each serializer. As the rows are already in
+        // memory, this measures parse throughput alone.
+        constexpr int iterations{ 50 };
+        std::size_t rows{ 0 };
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            rows += result.rows_as<couchbase::codec::tao_json_serializer, airport>().size();
+        }
+        auto tao_elapsed = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            rows += result.rows_as<simdjson_serializer, airport>().size();
+        }
+        auto simdjson_elapsed = std::chrono::steady_clock::now() - start;
+
+        auto rows_per_second = [&](auto elapsed) {
+            auto seconds = std::chrono::duration<double>(elapsed).count();
+            return static_cast<double>(rows / 2) / seconds;
+        };
+        fmt::println("taoJSON:  {:.0f} rows/s", rows_per_second(tao_elapsed));
+        fmt::println("simdjson: {:.0f} rows/s", rows_per_second(simdjson_elapsed));
+        // #end::benchmark[]
+    }
+
+    {
+        // #tag::kv[]
+        auto collection = cluster.bucket("travel-sample").scope("inventory").collection("airport");
+        auto [err, result] = collection.get("airport_1254").get();
+        if (!err) {
+            // Types without a simdjson_binding, such as tao::json::value, are converted from the
+            // simdjson parse result
+            auto value = result.content_as<tao::json::value, simdjson_transcoder>();
+            collection.upsert<simdjson_transcoder>("airport_1254-copy", value).get();
+        }
+        // #end::kv[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
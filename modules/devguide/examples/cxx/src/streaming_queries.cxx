@@ -0,0 +1,382 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/codec/tao_json_serializer.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ "inventory" };
+
+// #tag::cursor[]
+// Fetches up to `limit` rows whose key sorts after `after` (or from the start, if empty), and
+// passes them to the handler as raw JSON.
+using page_handler = std::function<void(couchbase::error, std::vector<couchbase::codec::binary>)>;
+using page_fetcher = std::function<void(const std::string& after, std::size_t limit, page_handler)>;
+
+// How far a cursor has got. `waited` is the time next() spent blocked on the server: when it is
+// a small part of `elapsed`, the application rather than the query is what limits the rate.
+struct cursor_progress {
+    std::uint64_t rows{ 0 };
+    std::uint64_t bytes{ 0 };
+    std::uint64_t pages{ 0 };
+    std::chrono::steady_clock::duration elapsed{};
+    std::chrono::steady_clock::duration waited{};
+
+    auto rows_per_second() const -> double
+    {
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? static_cast<double>(rows) / seconds : 0.0;
+    }
+
+    auto bytes_per_second() const -> double
+    {
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? static_cast<double>(bytes) / seconds : 0.0;
+    }
+};
+
+// Hands out the rows of a result set one at a time, fetching them a page at a time in the
+// background. At most `buffer_rows` rows are held in memory at once: the next page is requested
+// as soon as there is room for it, so the application rarely has to wait, yet a slow consumer
+// never causes the whole result set to pile up in memory.
+class row_cursor
+{
+  public:
+    row_cursor(page_fetcher fetch, std::string key_field, std::size_t buffer_rows)
+      : state_{ std::make_shared<state>() }
+    {
+        state_->fetch = std::move(fetch);
+        state_->key_field = std::move(key_field);
+        state_->capacity = std::max<std::size_t>(buffer_rows, 2);
+        state_->page_size = state_->capacity / 2;
+        std::unique_lock lock(state_->mutex);
+        maybe_fetch(state_, lock);
+    }
+
+    row_cursor(const row_cursor&) = delete;
+    auto operator=(const row_cursor&) -> row_cursor& = delete;
+
+    ~row_cursor()
+    {
+        cancel();
+    }
+
+    // Blocks until the next row is available. Returns std::nullopt once all rows have been read,
+    // the cursor has been cancelled, or a page failed -- check error() to tell which.
+    auto next() -> std::optional<couchbase::codec::binary>
+    {
+        std::unique_lock lock(state_->mutex);
+        auto start = std::chrono::steady_clock::now();
+        state_->ready.wait(lock, [this] {
+            return !state_->rows.empty() || state_->done || state_->cancelled;
+        });
+        state_->progress.waited += std::chrono::steady_clock::now() - start;
+        if (state_->rows.empty() || state_->cancelled) {
+            return std::nullopt;
+        }
+        auto row = std::move(state_->rows.front());
+        state_->rows.pop_front();
+        ++state_->progress.rows;
+        maybe_fetch(state_, lock);
+        return row;
+    }
+
+    template<typename Row = tao::json::value>
+    auto next_as() -> std::optional<Row>
+    {
+        auto row = next();
+        if (!row) {
+            return std::nullopt;
+        }
+        return couchbase::codec::tao_json_serializer::deserialize<Row>(*row);
+    }
+
+    // Stops fetching further pages and drops any buffered rows. A page which is already in
+    // flight is discarded when it arrives.
+    void cancel()
+    {
+        std::scoped_lock lock(state_->mutex);
+        state_->cancelled = true;
+        state_->rows.clear();
+        state_->ready.notify_all();
+    }
+
+    auto error() const -> couchbase::error
+    {
+        std::scoped_lock lock(state_->mutex);
+        return state_->error;
+    }
+
+    // The rows read and the bytes received so far, since the cursor was created.
+    auto progress() const -> cursor_progress
+    {
+        std::scoped_lock lock(state_->mutex);
+        auto progress = state_->progress;
+        progress.elapsed = std::chrono::steady_clock::now() - state_->started;
+        return progress;
+    }
+
+  private:
+    // Shared with the page callbacks, so that a page arriving after the cursor has gone away is
+    // simply dropped.
+    struct state {
+        page_fetcher fetch{};
+        std::string key_field{};
+        std::size_t capacity{};
+        std::size_t page_size{};
+        std::mutex mutex{};
+        std::condition_variable ready{};
+        std::deque<couchbase::codec::binary> rows{};
+        std::string last_key{};
+        couchbase::error error{};
+        std::chrono::steady_clock::time_point started{ std::chrono::steady_clock::now() };
+        cursor_progress progress{};
+        bool fetching{ false };
+        bool done{ false };
+        bool cancelled{ false };
+    };
+
+    static void maybe_fetch(const std::shared_ptr<state>& self, std::unique_lock<std::mutex>& lock)
+    {
+        if (self->fetching || self->done || self->cancelled ||
+            self->rows.size() + self->page_size > self->capacity) {
+            return;
+        }
+        self->fetching = true;
+        auto after = self->last_key;
+        auto limit = self->page_size;
+        lock.unlock();
+        self->fetch(after, limit, [self](auto err, auto page) {
+            on_page(self, std::move(err), std::move(page));
+        });
+        lock.lock();
+    }
+
+    static void on_page(
+      const std::shared_ptr<state>& self,
+      couchbase::error err,
+      std::vector<couchbase::codec::binary> page
+    )
+    {
+        std::unique_lock lock(self->mutex);
+        self->fetching = false;
+        if (self->cancelled) {
+            return;
+        }
+        if (err) {
+            self->error = std::move(err);
+            self->done = true;
+        } else {
+            if (page.size() < self->page_size) {
+                self->done = true; // a short page is the last one
+            }
+            if (!page.empty()) {
+                // Only the last row of each page is parsed here, to find where the next page starts
+                auto last = couchbase::codec::tao_json_serializer::deserialize<tao::json::value>(
+                  page.back()
+                );
+                self->last_key = last.at(self->key_field).get_string();
+            }
+            ++self->progress.pages;
+            for (auto& row : page) {
+                self->progress.bytes += row.size();
+                self->rows.push_back(std::move(row));
+            }
+        }
+        self->ready.notify_all();
+        maybe_fetch(self, lock);
+    }
+
+    std::shared_ptr<state> state_;
+};
+// #end::cursor[]
+
+// #tag::fetchers[]
+// Pages through a SQL++ query using keyset pagination. The statement must order its results by
+// the key, and take the key to start after and the page size as the $after and $limit parameters.
+auto
+query_pages(couchbase::scope scope, std::string statement, couchbase::query_options options = {})
+  -> page_fetcher
+{
+    return [scope = std::move(scope), statement = std::move(statement), options](
+             const std::string& after, std::size_t limit, page_handler handler
+           ) mutable {
+        options.named_parameters(std::pair{ "after", after }, std::pair{ "limit", limit });
+        scope.query(statement, options, [handler = std::move(handler)](auto err, auto result) {
+            auto rows = err ? std::vector<couchbase::codec::binary>{} : result.rows_as_binary();
+            handler(std::move(err), std::move(rows));
+        });
+    };
+}
+
+// The same, for an analytics query.
+auto
+analytics_pages(
+  couchbase::cluster cluster,
+  std::string statement,
+  couchbase::analytics_options options = {}
+) -> page_fetcher
+{
+    return [cluster = std::move(cluster), statement = std::move(statement), options](
+             const std::string& after, std::size_t limit, page_handler handler
+           ) mutable {
+        options.named_parameters(std::pair{ "after", after }, std::pair{ "limit", limit });
+        cluster.analytics_query(
+          statement, options, [handler = std::move(handler)](auto err, auto result) {
+              auto rows = err ? std::vector<couchbase::codec::binary>{} : result.rows_as_binary();
+              handler(std::move(err), std::move(rows));
+          }
+        );
+    };
+}
+// #end::fetchers[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto scope = cluster.bucket(bucket_name).scope(scope_name);
+
+    {
+        // #tag::query-cursor[]
+        std::string statement{ R"(
+            SELECT META(r).id AS id, r.airline, r.sourceairport, r.destinationairport
+            FROM route AS r
+            WHERE META(r).id > $after
+            ORDER BY META(r).id
+            LIMIT $limit
+        )" };
+
+        auto start = std::chrono::steady_clock::now();
+        row_cursor cursor(query_pages(scope, statement), "id", /* buffer_rows */ 1000);
+
+        std::size_t count{ 0 };
+        while (auto row = cursor.next_as()) {
+            if (count++ == 0) {
+                auto first = std::chrono::steady_clock::now() - start;
+                fmt::println(
+                  "First row after {}: {}",
+                  std::chrono::duration_cast<std::chrono::milliseconds>(first),
+                  tao::json::to_string(*row)
+                );
+            }
+        }
+        if (auto err = cursor.error(); err) {
+            fmt::println("Error: {}", err);
+        }
+        fmt::println("Read {} rows", count);
+        // #end::query-cursor[]
+    }
+
+    {
+        // #tag::cancel[]
+        // Stop as soon as we have found what we were looking for: no further pages are fetched
+        row_cursor cursor(
+          query_pages(
+            scope,
+            "SELECT META(a).id AS id, a.* FROM airport AS a "
+            "WHERE META(a).id > $after ORDER BY META(a).id LIMIT $limit"
+          ),
+          "id",
+          /* buffer_rows */ 200
+        );
+        while (auto row = cursor.next_as()) {
+            if (row->at("country").get_string() == "France") {
+                fmt::println("First French airport: {}", row->at("airportname").get_string());
+                cursor.cancel();
+            }
+        }
+        // #end::cancel[]
+    }
+
+    {
+        // #tag::analytics-cursor[]
+        row_cursor cursor(
+          analytics_pages(
+            cluster,
+            "SELECT META(a).id AS id, a.airportname, a.country FROM airports a "
+            "WHERE META(a).id > $after ORDER BY META(a).id LIMIT $limit"
+          ),
+          "id",
+          /* buffer_rows */ 1000
+        );
+        while (auto row = cursor.next_as()) {
+            fmt::println("row: {}", tao::json::to_string(*row));
+        }
+        if (auto err = cursor.error(); err) {
+            fmt::println("Got an error doing analytics query: {}", err);
+        }
+        // #end::analytics-cursor[]
+    }
+
+    {
+        // #tag::analytics-progress[]
+        // An export of French airports -- there are about 220 in travel-sample -- reporting its
+        // progress as it goes. Each page of 40 rows is a separate request with its own timeout, so
+        // no single request runs for long.
+        row_cursor cursor(
+          analytics_pages(
+            cluster,
+            "SELECT META(a).id AS id, a.airportname, a.country FROM airports a "
+            "WHERE a.country = 'France' AND META(a).id > $after ORDER BY META(a).id LIMIT $limit",
+            couchbase::analytics_options().timeout(std::chrono::milliseconds(90000))
+          ),
+          "id",
+          /* buffer_rows */ 80
+        );
+        auto report = [&cursor] {
+            auto progress = cursor.progress();
+            fmt::println(
+              "{} rows, {} bytes in {} pages: {:.0f} rows/s, {:.0f} bytes/s, {} waiting for rows",
+              progress.rows,
+              progress.bytes,
+              progress.pages,
+              progress.rows_per_second(),
+              progress.bytes_per_second(),
+              std::chrono::duration_cast<std::chrono::milliseconds>(progress.waited)
+            );
+        };
+        while (auto row = cursor.next_as()) {
+            auto rows = cursor.progress().rows;
+            if (rows % 50 == 0) {
+                report();
+            }
+            // The export only needs the first 150: no further pages are requested after this
+            if (rows == 150) {
+                cursor.cancel();
+            }
+        }
+        report();
+        // #end::analytics-progress[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,277 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "default" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::coalescer[]
+// Collects sub-document specs for the same document, from any number of callers, and sends them
+// as one lookup_in (or mutate_in) request. Specs are held for at most `window` after the first
+// one for a document arrives, or until the server's limit of 16 specs per request is reached.
+// Each caller's handler then receives the shared result along with the index of its own spec.
+// The coalescer must outlive those handlers, so its destructor waits for them.
+//
+// Coalesced mutations are applied atomically together, so a spec which fails causes the other
+// mutations sent with it to fail as well.
+template<typename Specs, typename Result>
+class subdoc_coalescer
+{
+  public:
+    static constexpr std::size_t max_specs{ 16 };
+
+    using handler = std::function<void(const couchbase::error&, const Result&, std::size_t)>;
+
+    subdoc_coalescer(couchbase::collection collection, std::chrono::microseconds window)
+      : collection_{ std::move(collection) }
+      , window_{ window }
+      , timer_{ [this] { run(); } }
+    {
+    }
+
+    subdoc_coalescer(const subdoc_coalescer&) = delete;
+    auto operator=(const subdoc_coalescer&) -> subdoc_coalescer& = delete;
+
+    ~subdoc_coalescer()
+    {
+        {
+            std::scoped_lock lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        timer_.join();
+        flush();
+    }
+
+    // Queues `spec` -- e.g. lookup_in_specs::get("name") -- for the document `id`.
+    template<typename Spec>
+    void add(const std::string& id, const Spec& spec, handler on_result)
+    {
+        std::vector<pending_spec> full;
+        {
+            std::scoped_lock lock(mutex_);
+            auto& document = pending_[id];
+            if (document.specs.empty()) {
+                document.deadline = std::chrono::steady_clock::now() + window_;
+                changed_.notify_all();
+            }
+            document.specs.push_back(
+              { [spec](Specs& specs) { specs.push_back(spec); }, std::move(on_result) }
+            );
+            if (document.specs.size() == max_specs) {
+                full = std::move(document.specs);
+                pending_.erase(id);
+            }
+        }
+        if (!full.empty()) {
+            send(id, std::move(full));
+        }
+    }
+
+    // Sends everything that is queued straight away, and waits until the handlers of every
+    // request sent so far have returned. Must not be called from one of those handlers.
+    void flush()
+    {
+        std::map<std::string, pending_document> due;
+        {
+            std::scoped_lock lock(mutex_);
+            due.swap(pending_);
+        }
+        for (auto& [id, document] : due) {
+            send(id, std::move(document.specs));
+        }
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [this] { return in_flight_ == 0; });
+    }
+
+    // The number of specs queued so far, and the number of requests they were sent in.
+    auto specs() const -> std::size_t
+    {
+        return specs_;
+    }
+
+    auto round_trips() const -> std::size_t
+    {
+        return round_trips_;
+    }
+
+  private:
+    struct pending_spec {
+        std::function<void(Specs&)> append;
+        handler on_result;
+    };
+
+    struct pending_document {
+        std::chrono::steady_clock::time_point deadline{};
+        std::vector<pending_spec> specs{};
+    };
+
+    void send(const std::string& id, std::vector<pending_spec> batch)
+    {
+        Specs specs;
+        for (const auto& pending : batch) {
+            pending.append(specs);
+        }
+        specs_ += batch.size();
+        ++round_trips_;
+        {
+            std::scoped_lock lock(mutex_);
+            ++in_flight_;
+        }
+
+        auto fan_out = [this, batch = std::move(batch)](auto err, auto result) {
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                batch[i].on_result(err, result, i);
+            }
+            // Notify under the lock: once in_flight_ reaches zero, flush() may return and the
+            // coalescer be destroyed
+            std::scoped_lock lock(mutex_);
+            if (--in_flight_ == 0) {
+                idle_.notify_all();
+            }
+        };
+        if constexpr (std::is_same_v<Specs, couchbase::lookup_in_specs>) {
+            collection_.lookup_in(id, specs, {}, std::move(fan_out));
+        } else {
+            collection_.mutate_in(id, specs, {}, std::move(fan_out));
+        }
+    }
+
+    // Sends each document's specs once its window has elapsed.
+    void run()
+    {
+        std::unique_lock lock(mutex_);
+        while (!stopping_) {
+            auto now = std::chrono::steady_clock::now();
+            auto next_deadline = std::chrono::steady_clock::time_point::max();
+            std::vector<std::pair<std::string, std::vector<pending_spec>>> due;
+            for (auto it = pending_.begin(); it != pending_.end();) {
+                if (it->second.deadline <= now) {
+                    due.emplace_back(it->first, std::move(it->second.specs));
+                    it = pending_.erase(it);
+                } else {
+                    next_deadline = std::min(next_deadline, it->second.deadline);
+                    ++it;
+                }
+            }
+            if (!due.empty()) {
+                lock.unlock();
+                for (auto& [id, specs] : due) {
+                    send(id, std::move(specs));
+                }
+                lock.lock();
+                continue;
+            }
+            if (next_deadline == std::chrono::steady_clock::time_point::max()) {
+                changed_.wait(lock);
+            } else {
+                changed_.wait_until(lock, next_deadline);
+            }
+        }
+    }
+
+    couchbase::collection collection_;
+    std::chrono::microseconds window_;
+    std::mutex mutex_{};
+    std::condition_variable changed_{};
+    std::condition_variable idle_{};
+    std::map<std::string, pending_document> pending_{};
+    std::size_t in_flight_{ 0 };
+    bool stopping_{ false };
+    std::atomic<std::size_t> specs_{ 0 };
+    std::atomic<std::size_t> round_trips_{ 0 };
+    std::thread timer_;
+};
+
+using lookup_coalescer = subdoc_coalescer<couchbase::lookup_in_specs, couchbase::lookup_in_result>;
+using mutation_coalescer =
+  subdoc_coalescer<couchbase::mutate_in_specs, couchbase::mutate_in_result>;
+// #end::coalescer[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    {
+        // #tag::lookup[]
+        lookup_coalescer lookups(collection, std::chrono::milliseconds(1));
+
+        // Independent parts of the application each ask for the field they need...
+        std::vector<std::future<std::string>> fields;
+        for (const auto* path : { "name", "email", "addresses.delivery.country" }) {
+            auto barrier = std::make_shared<std::promise<std::string>>();
+            fields.push_back(barrier->get_future());
+            lookups.add(
+              "customer123",
+              couchbase::lookup_in_specs::get(path),
+              [barrier](const auto& err, const auto& result, std::size_t index) {
+                  if (err) {
+                      barrier->set_value(fmt::format("error: {}", err.ec().message()));
+                  } else {
+                      barrier->set_value(result.template content_as<std::string>(index));
+                  }
+              }
+            );
+        }
+
+        // ...and the lookups are sent to the server as a single request
+        for (auto& field : fields) {
+            fmt::println("{}", field.get());
+        }
+        fmt::println("{} specs in {} round trip(s)", lookups.specs(), lookups.round_trips());
+        // #end::lookup[]
+    }
+
+    {
+        // #tag::mutate[]
+        mutation_coalescer mutations(collection, std::chrono::milliseconds(1));
+        for (int i = 0; i < 10; ++i) {
+            mutations.add(
+              "customer123",
+              couchbase::mutate_in_specs::increment("logins", 1),
+              [](const auto& err, const auto& /* result */, std::size_t index) {
+                  if (err) {
+                      fmt::println("Increment {} failed: {}", index, err);
+                  }
+              }
+            );
+        }
+        // Sends the increments and waits for them, so the cluster can be closed safely
+        mutations.flush();
+        // #end::mutate[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
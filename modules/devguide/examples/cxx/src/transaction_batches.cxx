@@ -0,0 +1,275 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <tao/json/value.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::batches[]
+namespace batch
+{
+using couchbase::transactions::async_attempt_context;
+using couchbase::transactions::attempt_context;
+using couchbase::transactions::transaction_get_result;
+
+using get_results = std::vector<std::pair<couchbase::error, transaction_get_result>>;
+using get_results_handler = std::function<void(get_results)>;
+
+// New content for documents read earlier in the transaction.
+template<typename Content>
+using replacements = std::vector<std::pair<transaction_get_result, Content>>;
+
+// Starts `count` operations at once with `start(index, done)`, and calls `handler` with all of
+// their results, in the order they were started, once the last of them has finished.
+template<typename Result, typename Start>
+void
+fan_in(std::size_t count, Start&& start, std::function<void(std::vector<Result>)> handler)
+{
+    struct state {
+        std::vector<Result> results;
+        std::atomic<std::size_t> remaining;
+        std::function<void(std::vector<Result>)> handler;
+    };
+    auto shared = std::make_shared<state>();
+    shared->results.resize(count);
+    shared->remaining = count;
+    shared->handler = std::move(handler);
+    if (count == 0) {
+        shared->handler({});
+        return;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        start(i, [shared, i](Result result) {
+            shared->results[i] = std::move(result);
+            if (--shared->remaining == 0) {
+                shared->handler(std::move(shared->results));
+            }
+        });
+    }
+}
+
+// Reads every document in `ids` in parallel, as part of the transaction.
+inline void
+get_all(
+  const std::shared_ptr<async_attempt_context>& ctx,
+  const couchbase::collection& collection,
+  const std::vector<std::string>& ids,
+  get_results_handler&& handler
+)
+{
+    fan_in<get_results::value_type>(
+      ids.size(),
+      [&](std::size_t i, auto done) {
+          ctx->get(collection, ids[i], [done = std::move(done)](auto err, auto document) {
+              done({ err, std::move(document) });
+          });
+      },
+      std::move(handler)
+    );
+}
+
+// Stages a replacement for every document in parallel. Each document must appear only once.
+template<typename Content>
+void
+replace_all(
+  const std::shared_ptr<async_attempt_context>& ctx,
+  const replacements<Content>& documents,
+  get_results_handler&& handler
+)
+{
+    fan_in<get_results::value_type>(
+      documents.size(),
+      [&](std::size_t i, auto done) {
+          const auto& [document, content] = documents[i];
+          ctx->replace(document, content, [done = std::move(done)](auto err, auto replaced) {
+              done({ err, std::move(replaced) });
+          });
+      },
+      std::move(handler)
+    );
+}
+
+// Calls `operation(i)` for every `i` below `count`, from at most `threads` threads including the
+// calling one, and returns the results in order once all of them have finished.
+template<typename Operation>
+auto
+in_parallel(std::size_t count, std::size_t threads, Operation operation) -> get_results
+{
+    get_results results(count);
+    std::atomic<std::size_t> next{ 0 };
+    auto work = [&] {
+        for (auto i = next++; i < count; i = next++) {
+            results[i] = operation(i);
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (std::size_t t = 1; t < std::min(threads, count); ++t) {
+        workers.push_back(std::async(std::launch::async, work));
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.get();
+    }
+    return results;
+}
+
+// The same, for the blocking API: the operations are shared among up to `threads` threads, each
+// issuing one at a time.
+inline auto
+get_all(
+  const std::shared_ptr<attempt_context>& ctx,
+  const couchbase::collection& collection,
+  const std::vector<std::string>& ids,
+  std::size_t threads = 8
+) -> get_results
+{
+    return in_parallel(ids.size(), threads, [&](std::size_t i) {
+        return ctx->get(collection, ids[i]);
+    });
+}
+
+template<typename Content>
+auto
+replace_all(
+  const std::shared_ptr<attempt_context>& ctx,
+  const replacements<Content>& documents,
+  std::size_t threads = 8
+) -> get_results
+{
+    return in_parallel(documents.size(), threads, [&](std::size_t i) {
+        const auto& [document, content] = documents[i];
+        return ctx->replace(document, content);
+    });
+}
+
+// The first error among `results`, if any, so that the transaction can be rolled back.
+inline auto
+first_error(const get_results& results) -> couchbase::error
+{
+    for (const auto& [err, document] : results) {
+        if (err) {
+            return err;
+        }
+    }
+    return {};
+}
+} // namespace batch
+// #end::batches[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+
+    std::vector<std::string> ids;
+    for (int i = 0; i < 20; ++i) {
+        ids.push_back(fmt::format("account-{}", i));
+        collection.upsert(ids.back(), tao::json::value{ { "balance", 100 } }).get();
+    }
+
+    {
+        // #tag::blocking[]
+        auto start = std::chrono::steady_clock::now();
+        auto [err, result] = cluster.transactions()->run(
+          [&](std::shared_ptr<couchbase::transactions::attempt_context> ctx) -> couchbase::error {
+              // Eight documents at a time: three round trips' worth of latency for all 20, not 20
+              auto documents = batch::get_all(ctx, collection, ids);
+              if (auto get_err = batch::first_error(documents); get_err) {
+                  return get_err; // Roll back the transaction
+              }
+
+              batch::replacements<tao::json::value> replacements;
+              for (auto& [get_err, document] : documents) {
+                  auto content = document.content_as<tao::json::value>();
+                  content["balance"] = content["balance"].get_signed() + 1;
+                  replacements.emplace_back(std::move(document), std::move(content));
+              }
+              return batch::first_error(batch::replace_all(ctx, replacements));
+          }
+        );
+        if (err) {
+            fmt::println("Transaction finished with error: {}", err);
+        } else {
+            fmt::println(
+              "Updated {} documents in {}",
+              ids.size(),
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start
+              )
+            );
+        }
+        // #end::blocking[]
+    }
+
+    {
+        // #tag::async[]
+        auto barrier = std::make_shared<
+          std::promise<std::pair<couchbase::error, couchbase::transactions::transaction_result>>>();
+        auto fut = barrier->get_future();
+
+        cluster.transactions()->run(
+          [&](std::shared_ptr<couchbase::transactions::async_attempt_context> ctx
+          ) -> couchbase::error {
+              auto err_barrier = std::make_shared<std::promise<couchbase::error>>();
+              auto err_fut = err_barrier->get_future();
+
+              batch::get_all(ctx, collection, ids, [ctx, err_barrier](auto documents) {
+                  if (auto err = batch::first_error(documents); err) {
+                      err_barrier->set_value(err); // Roll back the transaction
+                      return;
+                  }
+                  batch::replacements<tao::json::value> replacements;
+                  for (auto& [err, document] : documents) {
+                      auto content = document.template content_as<tao::json::value>();
+                      content["balance"] = content["balance"].get_signed() - 1;
+                      replacements.emplace_back(std::move(document), std::move(content));
+                  }
+                  batch::replace_all(ctx, replacements, [err_barrier](auto replaced) {
+                      err_barrier->set_value(batch::first_error(replaced));
+                  });
+              });
+
+              return err_fut.get();
+          },
+          [barrier](auto err, auto result) { barrier->set_value({ err, result }); }
+        );
+
+        auto [err, result] = fut.get();
+        if (err) {
+            fmt::println("Transaction finished with error: {}", err);
+        } else {
+            fmt::println("Transaction finished successfully");
+        }
+        // #end::async[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,165 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+#include <tao/json/value.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+
+// #tag::bulk[]
+namespace bulk
+{
+using couchbase::transactions::attempt_context;
+
+// Runs `statement` -- which must select rows in ascending order of `key_field`, starting after
+// the key `$1`, and return at most `$2` of them -- a page at a time, and calls `handler` with each
+// page. Only one page of rows is held in memory at once, however many the statement matches.
+//
+// For example:
+//
+//   SELECT META(h).id AS id, h.reviews FROM hotel AS h
+//   WHERE META(h).id > $1 ORDER BY META(h).id LIMIT $2
+inline auto
+for_each_page(
+  const std::shared_ptr<attempt_context>& ctx,
+  const couchbase::scope& scope,
+  const std::string& statement,
+  const std::string& key_field,
+  std::size_t page_size,
+  const std::function<couchbase::error(std::vector<tao::json::value>&)>& handler
+) -> couchbase::error
+{
+    std::string after{};
+    while (true) {
+        auto options = couchbase::transactions::transaction_query_options();
+        options.positional_parameters(after, page_size);
+        auto [err, result] = ctx->query(scope, statement, options);
+        if (err) {
+            return err;
+        }
+        auto rows = result.rows_as_json();
+        if (rows.empty()) {
+            return {};
+        }
+        after = rows.back().at(key_field).get_string();
+        if (auto handler_err = handler(rows); handler_err) {
+            return handler_err;
+        }
+        if (rows.size() < page_size) {
+            return {};
+        }
+    }
+}
+
+// Sets `field` of each document in `updates` to its new value, with one UPDATE per `chunk_size`
+// documents rather than one per document. The document IDs and their values are sent as two
+// parameters, and the statement looks up each document's value by its ID. Returns the number of
+// documents updated.
+inline auto
+update_many(
+  const std::shared_ptr<attempt_context>& ctx,
+  const couchbase::scope& scope,
+  const std::string& collection,
+  const std::string& field,
+  const std::vector<std::pair<std::string, tao::json::value>>& updates,
+  std::size_t chunk_size = 1'000
+) -> std::pair<couchbase::error, std::uint64_t>
+{
+    auto statement =
+      fmt::format("UPDATE `{}` AS d USE KEYS $1 SET d.`{}` = $2.[META(d).id]", collection, field);
+    std::uint64_t updated{ 0 };
+    for (std::size_t start = 0; start < updates.size(); start += chunk_size) {
+        tao::json::value ids = tao::json::empty_array;
+        tao::json::value values = tao::json::empty_object;
+        for (std::size_t i = start; i < std::min(start + chunk_size, updates.size()); ++i) {
+            ids.push_back(updates[i].first);
+            values[updates[i].first] = updates[i].second;
+        }
+        // Metrics are only returned when asked for, and carry the number of documents changed
+        auto options = couchbase::transactions::transaction_query_options().metrics(true);
+        options.positional_parameters(ids, values);
+        auto [err, result] = ctx->query(scope, statement, options);
+        if (err) {
+            return { err, updated };
+        }
+        if (const auto& metrics = result.meta_data().metrics(); metrics.has_value()) {
+            updated += metrics->mutation_count();
+        }
+    }
+    return { {}, updated };
+}
+} // namespace bulk
+// #end::bulk[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto inventory = cluster.bucket("travel-sample").scope("inventory");
+
+    // This function (not provided here) will use a trained machine learning model to provide a
+    // suitable price based on recent customer reviews.
+    auto price_from_reviews = [](const tao::json::value& /* reviews */) { return 99.0; };
+
+    {
+        // #tag::reprice[]
+        auto [err, result] = cluster.transactions()->run(
+          [&](std::shared_ptr<couchbase::transactions::attempt_context> ctx) -> couchbase::error {
+              std::uint64_t repriced{ 0 };
+              auto page_err = bulk::for_each_page(
+                ctx,
+                inventory,
+                "SELECT META(h).id AS id, h.reviews FROM hotel AS h "
+                "WHERE META(h).id > $1 ORDER BY META(h).id LIMIT $2",
+                "id",
+                /* page_size */ 1'000,
+                [&](auto& rows) -> couchbase::error {
+                    std::vector<std::pair<std::string, tao::json::value>> prices;
+                    for (const auto& row : rows) {
+                        prices.emplace_back(
+                          row.at("id").get_string(), price_from_reviews(row.at("reviews"))
+                        );
+                    }
+                    auto [update_err, updated] =
+                      bulk::update_many(ctx, inventory, "hotel", "price", prices);
+                    repriced += updated;
+                    return update_err;
+                }
+              );
+              fmt::println("Repriced {} hotels", repriced);
+              return page_err;
+          },
+          // A large repricing runs for longer than the default transaction timeout
+          couchbase::transactions::transaction_options().timeout(std::chrono::minutes(10))
+        );
+        if (err) {
+            fmt::println("Transaction finished with error: {}", err);
+        } else {
+            fmt::println("Transaction {} committed", result.transaction_id);
+        }
+        // #end::reprice[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
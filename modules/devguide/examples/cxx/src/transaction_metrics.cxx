@@ -0,0 +1,339 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+#include <tao/json/value.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::meter[]
+// A meter which keeps a histogram per operation, so that it can report percentiles. Set it with
+// cluster_options::metrics().meter() to collect the SDK's own per-operation latencies alongside
+// the transaction timings below.
+class percentile_meter : public couchbase::metrics::meter
+{
+  public:
+    auto get_value_recorder(
+      const std::string& name,
+      const std::map<std::string, std::string>& tags
+    ) -> std::shared_ptr<couchbase::metrics::value_recorder> override
+    {
+        auto key = name;
+        for (const auto& [tag, value] : tags) {
+            key += fmt::format(" {}={}", tag, value);
+        }
+        std::scoped_lock lock(mutex_);
+        auto& slot = recorders_[key];
+        if (!slot) {
+            slot = std::make_shared<recorder>();
+        }
+        return slot;
+    }
+
+    // Prints count, p50, p90, p99 and maximum for everything recorded since the last report, then
+    // starts again.
+    void report()
+    {
+        std::scoped_lock lock(mutex_);
+        for (const auto& [key, values] : recorders_) {
+            auto summary = values->take();
+            if (summary.count == 0) {
+                continue;
+            }
+            fmt::println(
+              "{:<56} n={:<6} p50={:<8} p90={:<8} p99={:<8} max={}",
+              key,
+              summary.count,
+              summary.p50,
+              summary.p90,
+              summary.p99,
+              summary.max
+            );
+        }
+    }
+
+  private:
+    struct summary {
+        std::uint64_t count{ 0 };
+        std::int64_t p50{ 0 };
+        std::int64_t p90{ 0 };
+        std::int64_t p99{ 0 };
+        std::int64_t max{ 0 };
+    };
+
+    // A log-linear histogram: values below 16 have a bucket each, and every power of two above
+    // that is split into 16 buckets, so a percentile is reported within 1/16 of its true value.
+    // Its size is fixed, however many values are recorded.
+    class recorder : public couchbase::metrics::value_recorder
+    {
+      public:
+        void record_value(std::int64_t value) override
+        {
+            value = std::max<std::int64_t>(value, 0);
+            std::scoped_lock lock(mutex_);
+            ++buckets_[bucket_of(static_cast<std::uint64_t>(value))];
+            ++count_;
+            max_ = std::max(max_, value);
+        }
+
+        // Summarises the values recorded so far, and clears them.
+        auto take() -> summary
+        {
+            std::scoped_lock lock(mutex_);
+            summary result{ count_, 0, 0, 0, max_ };
+            if (count_ > 0) {
+                result.p50 = percentile(50);
+                result.p90 = percentile(90);
+                result.p99 = percentile(99);
+            }
+            buckets_.fill(0);
+            count_ = 0;
+            max_ = 0;
+            return result;
+        }
+
+      private:
+        static constexpr unsigned sub_bucket_bits{ 4 };
+        static constexpr std::uint64_t sub_buckets{ 1U << sub_bucket_bits };
+
+        static auto bucket_of(std::uint64_t value) -> std::size_t
+        {
+            if (value < sub_buckets) {
+                return static_cast<std::size_t>(value);
+            }
+            unsigned top_bit = 0;
+            while ((value >> (top_bit + 1)) != 0) {
+                ++top_bit;
+            }
+            auto shift = top_bit - sub_bucket_bits;
+            return static_cast<std::size_t>(
+              ((shift + 1) << sub_bucket_bits) | ((value >> shift) & (sub_buckets - 1))
+            );
+        }
+
+        // The largest value which falls into `bucket`.
+        static auto highest_in(std::size_t bucket) -> std::int64_t
+        {
+            if (bucket < sub_buckets) {
+                return static_cast<std::int64_t>(bucket);
+            }
+            auto shift = (bucket >> sub_bucket_bits) - 1;
+            auto lowest = (sub_buckets | (bucket & (sub_buckets - 1))) << shift;
+            return static_cast<std::int64_t>(lowest + (std::uint64_t{ 1 } << shift) - 1);
+        }
+
+        auto percentile(std::uint64_t p) const -> std::int64_t
+        {
+            auto rank = (count_ - 1) * p / 100;
+            std::uint64_t seen{ 0 };
+            for (std::size_t bucket = 0; bucket < buckets_.size(); ++bucket) {
+                seen += buckets_[bucket];
+                if (seen > rank) {
+                    return std::min(highest_in(bucket), max_);
+                }
+            }
+            return max_;
+        }
+
+        std::mutex mutex_{};
+        std::array<std::uint64_t, (64 - sub_bucket_bits) * sub_buckets> buckets_{};
+        std::uint64_t count_{ 0 };
+        std::int64_t max_{ 0 };
+    };
+
+    std::mutex mutex_{};
+    std::map<std::string, std::shared_ptr<recorder>> recorders_{};
+};
+// #end::meter[]
+
+// #tag::instrumented[]
+// Runs transactions as cluster.transactions()->run() does, and records where their time goes:
+//
+//   db.couchbase.transactions      db.operation=attempt  the transaction lambda, per attempt
+//                                  db.operation=backoff  between the end of an attempt and the
+//                                                        start of its retry, including rollback
+//                                  db.operation=commit   from the lambda returning until run()
+//                                                        returns: commit and unstaging
+//                                  db.operation=total    the whole transaction
+//   db.couchbase.transactions.attempts                   attempts per transaction
+//
+// Durations are in microseconds, as with the SDK's own metrics. Each transaction also gets a
+// span, with a child span per attempt, from the tracer if one is given. Retries -- and so
+// attempts above one -- are mostly caused by write-write conflicts with other transactions.
+//
+// Cleanup of failed attempts happens in the background and is not visible here; a transaction
+// whose unstaging was left to it is counted under db.couchbase.transactions.cleanup_deferred.
+class instrumented_transactions
+{
+  public:
+    instrumented_transactions(
+      std::shared_ptr<couchbase::transactions::transactions> transactions,
+      std::shared_ptr<couchbase::metrics::meter> meter,
+      std::shared_ptr<couchbase::tracing::request_tracer> tracer = {}
+    )
+      : transactions_{ std::move(transactions) }
+      , attempt_{ recorder(*meter, "db.couchbase.transactions", "attempt") }
+      , backoff_{ recorder(*meter, "db.couchbase.transactions", "backoff") }
+      , commit_{ recorder(*meter, "db.couchbase.transactions", "commit") }
+      , total_{ recorder(*meter, "db.couchbase.transactions", "total") }
+      , attempts_{ meter->get_value_recorder("db.couchbase.transactions.attempts", {}) }
+      , cleanup_deferred_{
+          meter->get_value_recorder("db.couchbase.transactions.cleanup_deferred", {})
+      }
+      , tracer_{ std::move(tracer) }
+    {
+    }
+
+    auto run(
+      couchbase::transactions::txn_logic&& logic,
+      const couchbase::transactions::transaction_options& options = {}
+    ) -> std::pair<couchbase::error, couchbase::transactions::transaction_result>
+    {
+        using clock = std::chrono::steady_clock;
+        auto start = clock::now();
+        auto span = tracer_ ? tracer_->start_span("transaction") : nullptr;
+        std::uint64_t attempts{ 0 };
+        std::optional<clock::time_point> last_attempt_end{};
+
+        auto result = transactions_->run(
+          [&](std::shared_ptr<couchbase::transactions::attempt_context> ctx) -> couchbase::error {
+              auto attempt_start = clock::now();
+              if (last_attempt_end) {
+                  backoff_->record_value(microseconds(attempt_start - *last_attempt_end));
+              }
+              ++attempts;
+              auto attempt_span =
+                tracer_ ? tracer_->start_span("transaction.attempt", span) : nullptr;
+              auto err = logic(std::move(ctx));
+              last_attempt_end = clock::now();
+              attempt_->record_value(microseconds(*last_attempt_end - attempt_start));
+              if (attempt_span) {
+                  attempt_span->add_tag("db.couchbase.transactions.attempt", attempts);
+                  attempt_span->end();
+              }
+              return err;
+          },
+          options
+        );
+
+        auto end = clock::now();
+        if (last_attempt_end) {
+            commit_->record_value(microseconds(end - *last_attempt_end));
+        }
+        total_->record_value(microseconds(end - start));
+        attempts_->record_value(static_cast<std::int64_t>(attempts));
+        const auto& [err, outcome] = result;
+        if (!err && !outcome.unstaging_complete) {
+            cleanup_deferred_->record_value(1);
+        }
+        if (span) {
+            span->add_tag("db.couchbase.transactions.attempts", attempts);
+            span->add_tag("outcome", err ? err.ec().message() : std::string{ "committed" });
+            span->end();
+        }
+        return result;
+    }
+
+  private:
+    static auto recorder(
+      couchbase::metrics::meter& meter,
+      const std::string& name,
+      const std::string& operation
+    ) -> std::shared_ptr<couchbase::metrics::value_recorder>
+    {
+        return meter.get_value_recorder(name, { { "db.operation", operation } });
+    }
+
+    template<typename Duration>
+    static auto microseconds(Duration duration) -> std::int64_t
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+
+    std::shared_ptr<couchbase::transactions::transactions> transactions_;
+    std::shared_ptr<couchbase::metrics::value_recorder> attempt_;
+    std::shared_ptr<couchbase::metrics::value_recorder> backoff_;
+    std::shared_ptr<couchbase::metrics::value_recorder> commit_;
+    std::shared_ptr<couchbase::metrics::value_recorder> total_;
+    std::shared_ptr<couchbase::metrics::value_recorder> attempts_;
+    std::shared_ptr<couchbase::metrics::value_recorder> cleanup_deferred_;
+    std::shared_ptr<couchbase::tracing::request_tracer> tracer_;
+};
+// #end::instrumented[]
+
+auto
+main() -> int
+{
+    // #tag::configure[]
+    auto meter = std::make_shared<percentile_meter>();
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    options.metrics().enable(true).meter(meter);
+    // Try different settings here, and compare the commit and cleanup figures
+    options.transactions().durability_level(couchbase::durability_level::majority);
+    // #end::configure[]
+
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+    collection.upsert("contended", tao::json::value{ { "n", 0 } }).get();
+
+    {
+        // #tag::usage[]
+        instrumented_transactions transactions(cluster.transactions(), meter);
+
+        // Several threads updating the same document, so that some attempts conflict and retry
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([&] {
+                for (int i = 0; i < 50; ++i) {
+                    auto [err, result] = transactions.run([&](auto ctx) -> couchbase::error {
+                        auto [get_err, document] = ctx->get(collection, "contended");
+                        if (get_err) {
+                            return get_err;
+                        }
+                        auto content = document.template content_as<tao::json::value>();
+                        content["n"] = content["n"].get_signed() + 1;
+                        return ctx->replace(document, content).first;
+                    });
+                    if (err) {
+                        fmt::println("Transaction failed: {}", err);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        meter->report();
+        // #end::usage[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
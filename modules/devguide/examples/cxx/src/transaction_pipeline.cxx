@@ -0,0 +1,418 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+#include <tao/json/value.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ couchbase::scope::default_name };
+static constexpr auto collection_name{ couchbase::collection::default_name };
+
+// #tag::pipeline[]
+// Describes a transaction as a list of stages. The steps of each stage run concurrently, and a
+// stage starts once every step of the previous one has finished. run() returns as soon as the
+// transaction has started, and the result is delivered to the completion handler passed to it.
+// Nothing blocks: the attempt lambda starts the first stage and returns, and each stage is
+// started from the callback of the step which finished the one before. The SDK counts an
+// operation as in flight until its callback has returned, so it only commits once the last stage
+// has finished.
+//
+// Steps share the documents they have read or written by ID, so a `replace` step can use the
+// document fetched by an earlier `get` step. A step which fails stops the stages after it. Most
+// errors also fail the attempt, which is then rolled back or retried, but some leave it free to
+// commit -- document_not_found from a get, for instance -- and then whatever the earlier stages
+// staged is committed. Either way the completion handler receives the step's error, so check it
+// before relying on the transaction having made every change.
+class transaction_pipeline
+{
+  public:
+    using async_attempt_context = couchbase::transactions::async_attempt_context;
+    using transaction_get_result = couchbase::transactions::transaction_get_result;
+    using done_handler = std::function<void(couchbase::error)>;
+
+    // The documents seen by one attempt of the transaction, which steps may run concurrently.
+    class documents
+    {
+      public:
+        void put(const std::string& id, transaction_get_result document)
+        {
+            std::scoped_lock lock(mutex_);
+            documents_.insert_or_assign(id, std::move(document));
+        }
+
+        auto at(const std::string& id) const -> transaction_get_result
+        {
+            std::scoped_lock lock(mutex_);
+            return documents_.at(id);
+        }
+
+      private:
+        mutable std::mutex mutex_{};
+        std::map<std::string, transaction_get_result> documents_{};
+    };
+
+    using step = std::function<
+      void(const std::shared_ptr<async_attempt_context>&, documents&, done_handler)>;
+
+    // Adds a stage with a single step.
+    auto then(step next) -> transaction_pipeline&
+    {
+        stages_.push_back({ std::move(next) });
+        return *this;
+    }
+
+    // Adds a stage whose steps run concurrently.
+    auto all(std::vector<step> steps) -> transaction_pipeline&
+    {
+        stages_.push_back(std::move(steps));
+        return *this;
+    }
+
+    // Starts the transaction and returns straight away; `on_complete` is called once it has been
+    // committed or rolled back.
+    void run(
+      couchbase::transactions::transactions& transactions,
+      couchbase::transactions::async_txn_complete_logic&& on_complete,
+      const couchbase::transactions::transaction_options& options = {}
+    ) const
+    {
+        // The step errors of the latest attempt. Each attempt has its own, so that callbacks
+        // still arriving for an attempt which has been retried cannot affect the next one.
+        auto latest = std::make_shared<latest_attempt>();
+        transactions.run(
+          [stages = stages_, latest](std::shared_ptr<async_attempt_context> ctx
+          ) -> couchbase::error {
+              // The transaction may be retried, so every attempt starts from the first stage
+              auto state = std::make_shared<attempt>(std::move(ctx), stages);
+              latest->set(state->step_error);
+              attempt::run_stage(state, 0);
+              return {};
+          },
+          [latest, on_complete = std::move(on_complete)](auto err, auto result) {
+              auto step_err = latest->get()->get();
+              on_complete(step_err ? step_err : err, std::move(result));
+          },
+          options
+        );
+    }
+
+    template<typename Content>
+    static auto insert(couchbase::collection collection, std::string id, Content content) -> step
+    {
+        return [collection, id, content](const auto& ctx, documents& seen, done_handler done) {
+            ctx->insert(collection, id, content, [&seen, id, done](auto err, auto document) {
+                if (!err) {
+                    seen.put(id, std::move(document));
+                }
+                done(err);
+            });
+        };
+    }
+
+    static auto get(couchbase::collection collection, std::string id) -> step
+    {
+        return [collection, id](const auto& ctx, documents& seen, done_handler done) {
+            ctx->get(collection, id, [&seen, id, done](auto err, auto document) {
+                if (!err) {
+                    seen.put(id, std::move(document));
+                }
+                done(err);
+            });
+        };
+    }
+
+    // Replaces the document `id`, read by an earlier step, with `update(its current content)`.
+    template<typename Update>
+    static auto replace(std::string id, Update update) -> step
+    {
+        return [id, update](const auto& ctx, documents& seen, done_handler done) {
+            transaction_get_result document;
+            tao::json::value content;
+            try {
+                document = seen.at(id);
+                content = update(document.template content_as<tao::json::value>());
+            } catch (const std::exception& e) {
+                // Not read by an earlier step, not JSON, or rejected by `update`
+                done({ couchbase::errc::common::invalid_argument, e.what() });
+                return;
+            }
+            ctx->replace(document, content, [&seen, id, done](auto err, auto replaced) {
+                if (!err) {
+                    seen.put(id, std::move(replaced));
+                }
+                done(err);
+            });
+        };
+    }
+
+    static auto remove(std::string id) -> step
+    {
+        return [id](const auto& ctx, documents& seen, done_handler done) {
+            transaction_get_result document;
+            try {
+                document = seen.at(id);
+            } catch (const std::out_of_range& e) {
+                done({ couchbase::errc::common::invalid_argument, e.what() });
+                return;
+            }
+            ctx->remove(document, std::move(done));
+        };
+    }
+
+    static auto query(
+      couchbase::scope scope,
+      std::string statement,
+      couchbase::transactions::transaction_query_options options = {}
+    ) -> step
+    {
+        return [scope, statement, options](const auto& ctx, documents&, done_handler done) {
+            ctx->query(scope, statement, options, [done](auto err, auto) { done(err); });
+        };
+    }
+
+  private:
+    class first_error
+    {
+      public:
+        void set(const couchbase::error& err)
+        {
+            std::scoped_lock lock(mutex_);
+            if (!err_) {
+                err_ = err;
+            }
+        }
+
+        auto get() const -> couchbase::error
+        {
+            std::scoped_lock lock(mutex_);
+            return err_;
+        }
+
+        auto failed() const -> bool
+        {
+            return static_cast<bool>(get());
+        }
+
+      private:
+        mutable std::mutex mutex_{};
+        couchbase::error err_{};
+    };
+
+    class latest_attempt
+    {
+      public:
+        void set(std::shared_ptr<first_error> step_error)
+        {
+            std::scoped_lock lock(mutex_);
+            step_error_ = std::move(step_error);
+        }
+
+        auto get() const -> std::shared_ptr<first_error>
+        {
+            std::scoped_lock lock(mutex_);
+            return step_error_;
+        }
+
+      private:
+        mutable std::mutex mutex_{};
+        std::shared_ptr<first_error> step_error_{ std::make_shared<first_error>() };
+    };
+
+    // The state of one attempt, kept alive by the callbacks of the steps in flight.
+    struct attempt {
+        std::shared_ptr<async_attempt_context> ctx;
+        std::vector<std::vector<step>> stages;
+        documents seen{};
+        std::shared_ptr<first_error> step_error{ std::make_shared<first_error>() };
+
+        attempt(std::shared_ptr<async_attempt_context> ctx, std::vector<std::vector<step>> stages)
+          : ctx{ std::move(ctx) }
+          , stages{ std::move(stages) }
+        {
+        }
+
+        static void run_stage(const std::shared_ptr<attempt>& self, std::size_t index)
+        {
+            if (index == self->stages.size()) {
+                return;
+            }
+            auto& stage = self->stages[index];
+            if (stage.empty()) {
+                run_stage(self, index + 1);
+                return;
+            }
+            auto remaining = std::make_shared<std::atomic<std::size_t>>(stage.size());
+            for (auto& next : stage) {
+                next(self->ctx, self->seen, [self, index, remaining](couchbase::error err) {
+                    if (err) {
+                        self->step_error->set(err);
+                    }
+                    // Start the next stage before this callback returns, while the SDK still
+                    // counts the step as in flight
+                    if (--*remaining == 0 && !self->step_error->failed()) {
+                        run_stage(self, index + 1);
+                    }
+                });
+            }
+        }
+    };
+
+    std::vector<std::vector<step>> stages_{};
+};
+// #end::pipeline[]
+
+auto
+main() -> int
+{
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto collection = cluster.bucket(bucket_name).scope(scope_name).collection(collection_name);
+    auto inventory = cluster.bucket("travel-sample").scope("inventory");
+
+    {
+        collection.upsert("doc-b", tao::json::value{ { "foo", "bar" } }).get();
+        collection.upsert("doc-c", tao::json::value{ { "foo", "bar" } }).get();
+        collection.remove("doc-a").get();
+
+        // #tag::usage[]
+        // The same transaction as the nested callbacks of the async example: the insert and the
+        // two gets do not depend on each other, so they run at the same time
+        transaction_pipeline pipeline;
+        pipeline
+          .all({
+            transaction_pipeline::insert(collection, "doc-a", tao::json::value{ { "foo", "bar" } }),
+            transaction_pipeline::get(collection, "doc-b"),
+            transaction_pipeline::get(collection, "doc-c"),
+          })
+          .all({
+            transaction_pipeline::replace(
+              "doc-b",
+              [](tao::json::value content) {
+                  content["transactions"] = "are awesome";
+                  return content;
+              }
+            ),
+            transaction_pipeline::remove("doc-c"),
+          })
+          .then(transaction_pipeline::query(
+            inventory,
+            "UPDATE route SET airlineid = $1 WHERE airline = $2",
+            couchbase::transactions::transaction_query_options().positional_parameters(
+              "airline_137", "AF"
+            )
+          ));
+
+        auto done = std::make_shared<std::promise<void>>();
+        pipeline.run(*cluster.transactions(), [done](auto err, auto result) {
+            if (err) {
+                fmt::println("Transaction finished with error: {}", err);
+            } else {
+                fmt::println("Transaction {} finished successfully", result.transaction_id);
+            }
+            done->set_value();
+        });
+        // Only so that the example does not exit before the transaction has finished
+        done->get_future().wait();
+        // #end::usage[]
+    }
+
+    {
+        // #tag::benchmark[]
+        // Throughput of transactions which each read and update one document: one at a time with
+        // the blocking run(), and with up to `concurrency` pipelines in flight at once.
+        constexpr std::size_t transaction_count{ 2'000 };
+        constexpr std::size_t concurrency{ 256 };
+        for (std::size_t i = 0; i < transaction_count; ++i) {
+            collection.upsert(fmt::format("txn-bench-{}", i), tao::json::value{ { "n", 0 } }).get();
+        }
+        auto increment = [](tao::json::value content) {
+            content["n"] = content["n"].get_signed() + 1;
+            return content;
+        };
+        auto throughput = [](auto elapsed) {
+            return static_cast<double>(transaction_count) /
+                   std::chrono::duration<double>(elapsed).count();
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < transaction_count; ++i) {
+            auto id = fmt::format("txn-bench-{}", i);
+            cluster.transactions()->run([&](auto ctx) -> couchbase::error {
+                auto [err, document] = ctx->get(collection, id);
+                if (err) {
+                    return err;
+                }
+                auto content = increment(document.template content_as<tao::json::value>());
+                return ctx->replace(document, content).first;
+            });
+        }
+        auto blocking = throughput(std::chrono::steady_clock::now() - start);
+
+        // A counting semaphore, so that no more than `concurrency` transactions are in flight
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::size_t in_flight{ 0 };
+        std::size_t failed{ 0 };
+
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < transaction_count; ++i) {
+            auto id = fmt::format("txn-bench-{}", i);
+            {
+                std::unique_lock lock(mutex);
+                finished.wait(lock, [&] { return in_flight < concurrency; });
+                ++in_flight;
+            }
+            transaction_pipeline()
+              .then(transaction_pipeline::get(collection, id))
+              .then(transaction_pipeline::replace(id, increment))
+              .run(*cluster.transactions(), [&](auto err, auto) {
+                  std::scoped_lock lock(mutex);
+                  --in_flight;
+                  failed += err ? 1 : 0;
+                  finished.notify_all();
+              });
+        }
+        {
+            std::unique_lock lock(mutex);
+            finished.wait(lock, [&] { return in_flight == 0; });
+        }
+        auto pipelined = throughput(std::chrono::steady_clock::now() - start);
+
+        fmt::println(
+          "blocking run(): {:.0f} transactions/s, pipeline: {:.0f} transactions/s ({} failed)",
+          blocking,
+          pipelined,
+          failed
+        );
+        // #end::benchmark[]
+    }
+
+    cluster.close().get();
+    return 0;
+}
@@ -0,0 +1,206 @@
+// #tag::imports[]
+#include <couchbase/cluster.hxx>
+#include <couchbase/fmt/error.hxx>
+
+#include <fmt/format.h>
+#include <tao/json/to_string.hpp>
+#include <tao/json/value.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+// #end::imports[]
+
+static constexpr auto connection_string{ "couchbase://127.0.0.1" };
+static constexpr auto username{ "Administrator" };
+static constexpr auto password{ "password" };
+static constexpr auto bucket_name{ "travel-sample" };
+static constexpr auto scope_name{ "inventory" };
+
+// #tag::encoding[]
+// Encodes an embedding as its little-endian float32 bytes, in base64: the form the Search service
+// accepts as "vector_base64". Each dimension takes 5.3 characters, against the 18 or so of a
+// double written out as JSON text, and encoding needs no floating-point formatting at all.
+inline auto
+encode_float32_base64(const std::vector<float>& embedding) -> std::string
+{
+    static constexpr char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string bytes;
+    bytes.reserve(embedding.size() * sizeof(float));
+    for (float value : embedding) {
+        std::uint32_t bits;
+        static_assert(sizeof(bits) == sizeof(value));
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int shift = 0; shift < 32; shift += 8) {
+            bytes.push_back(static_cast<char>((bits >> shift) & 0xff));
+        }
+    }
+
+    std::string out;
+    out.reserve((bytes.size() + 2) / 3 * 4);
+    for (std::size_t i = 0; i < bytes.size(); i += 3) {
+        std::uint32_t chunk = static_cast<std::uint8_t>(bytes[i]) << 16;
+        if (i + 1 < bytes.size()) {
+            chunk |= static_cast<std::uint8_t>(bytes[i + 1]) << 8;
+        }
+        if (i + 2 < bytes.size()) {
+            chunk |= static_cast<std::uint8_t>(bytes[i + 2]);
+        }
+        out.push_back(alphabet[(chunk >> 18) & 0x3f]);
+        out.push_back(alphabet[(chunk >> 12) & 0x3f]);
+        out.push_back(i + 1 < bytes.size() ? alphabet[(chunk >> 6) & 0x3f] : '=');
+        out.push_back(i + 2 < bytes.size() ? alphabet[chunk & 0x3f] : '=');
+    }
+    return out;
+}
+
+// A vector query for a float32 embedding, sent in base64 rather than as an array of doubles.
+inline auto
+float32_vector_query(std::string field, const std::vector<float>& embedding)
+  -> couchbase::vector_query
+{
+    return couchbase::vector_query(std::move(field), encode_float32_base64(embedding));
+}
+// #end::encoding[]
+
+// #tag::batch[]
+// Sends every request in `requests` to the index, with up to `max_in_flight` of them outstanding
+// at once, and returns their results in the same order.
+inline auto
+search_many(
+  const couchbase::scope& scope,
+  const std::string& index_name,
+  const std::vector<couchbase::search_request>& requests,
+  const couchbase::search_options& options = {},
+  std::size_t max_in_flight = 16
+) -> std::vector<std::pair<couchbase::error, couchbase::search_result>>
+{
+    struct state {
+        std::mutex mutex{};
+        std::condition_variable changed{};
+        std::size_t in_flight{ 0 };
+        std::vector<std::pair<couchbase::error, couchbase::search_result>> results{};
+    };
+    auto shared = std::make_shared<state>();
+    shared->results.resize(requests.size());
+
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+        {
+            std::unique_lock lock(shared->mutex);
+            shared->changed.wait(lock, [&] { return shared->in_flight < max_in_flight; });
+            ++shared->in_flight;
+        }
+        scope.search(index_name, requests[i], options, [shared, i](auto err, auto result) {
+            std::scoped_lock lock(shared->mutex);
+            shared->results[i] = { err, std::move(result) };
+            --shared->in_flight;
+            shared->changed.notify_all();
+        });
+    }
+
+    std::unique_lock lock(shared->mutex);
+    shared->changed.wait(lock, [&] { return shared->in_flight == 0; });
+    return std::move(shared->results);
+}
+// #end::batch[]
+
+auto
+main() -> int
+{
+    auto random_embedding = [random = std::mt19937{ 42 }](std::size_t dimensions) mutable {
+        std::uniform_real_distribution<float> component(-1.0F, 1.0F);
+        std::vector<float> embedding(dimensions);
+        for (auto& value : embedding) {
+            value = component(random);
+        }
+        return embedding;
+    };
+
+    {
+        // #tag::benchmark[]
+        // The cost of turning an embedding into request text: as a JSON array of doubles, which
+        // is what vector_query does with a std::vector<double>, and as base64 float32.
+        constexpr int iterations{ 1'000 };
+        for (std::size_t dimensions : { 768, 1536 }) {
+            auto embedding = random_embedding(dimensions);
+
+            std::size_t json_size{ 0 };
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                tao::json::value array = tao::json::empty_array;
+                for (float value : embedding) {
+                    array.emplace_back(static_cast<double>(value));
+                }
+                json_size = tao::json::to_string(array).size();
+            }
+            auto json_time = (std::chrono::steady_clock::now() - start) / iterations;
+
+            std::size_t base64_size{ 0 };
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                base64_size = encode_float32_base64(embedding).size();
+            }
+            auto base64_time = (std::chrono::steady_clock::now() - start) / iterations;
+
+            using us = std::chrono::duration<double, std::micro>;
+            fmt::println(
+              "{:>4} dimensions: JSON {:>6} bytes {:>7.1f}us, base64 {:>6} bytes {:>7.1f}us",
+              dimensions,
+              json_size,
+              us(json_time).count(),
+              base64_size,
+              us(base64_time).count()
+            );
+        }
+        // #end::benchmark[]
+    }
+
+    auto options = couchbase::cluster_options(username, password);
+    options.apply_profile("wan_development");
+    auto [connect_err, cluster] = couchbase::cluster::connect(connection_string, options).get();
+    if (connect_err) {
+        fmt::println("Unable to connect to the cluster: {}", connect_err);
+        return 1;
+    }
+    auto scope = cluster.bucket(bucket_name).scope(scope_name);
+
+    {
+        // #tag::usage[]
+        // Embeddings for a batch of questions, as returned by a float32 embedding model
+        std::vector<std::vector<float>> embeddings;
+        for (int i = 0; i < 64; ++i) {
+            embeddings.push_back(random_embedding(1536));
+        }
+
+        std::vector<couchbase::search_request> requests;
+        for (const auto& embedding : embeddings) {
+            requests.emplace_back(couchbase::vector_search(
+              float32_vector_query("vector_field", embedding).num_candidates(10)
+            ));
+        }
+
+        auto results = search_many(scope, "vector-index", requests);
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const auto& [err, result] = results[i];
+            if (err) {
+                fmt::println("Question {}: {}", i, err);
+            } else {
+                fmt::println("Question {}: {} hits", i, result.rows().size());
+            }
+        }
+        // #end::usage[]
+    }
+
+    cluster.close().get();
+    return 0;
+}